@@ -0,0 +1,99 @@
+/**
+ * Benchmarks for the timer's own overhead and scaling:
+ *  - begin/end pair latency per clock backend
+ *  - per-thread scaling of concurrent probes
+ *  - cache behavior with 1 vs 200 live timers
+ *  - statistics-pass throughput over recorded samples
+ *
+ * Ring mode bounds memory so the hot-path benchmarks can run for as
+ * many iterations as the harness wants.
+ */
+#include <benchmark/benchmark.h>
+#include <timer.h>
+
+#include <vector>
+
+static void reinit(int backend)
+{
+  static bool inited = false;
+  if (inited)
+    timer_destroy();
+  inited = true;
+  timer_set_backend(backend);
+  timer_set_mode(TIMER_MODE_RING);
+  timer_init(1 << 16);
+}
+
+static void setup_gettime(const benchmark::State& state)
+{
+  reinit(TIMER_BACKEND_GETTIME);
+}
+
+static void setup_tsc(const benchmark::State& state)
+{
+  reinit(TIMER_BACKEND_TSC);
+}
+
+/* Latency of one begin/end pair on the selected backend */
+static void BM_BeginEndPair_Gettime(benchmark::State& state)
+{
+  for (auto _ : state) {
+    timer_begin(1);
+    timer_end(1);
+  }
+}
+BENCHMARK(BM_BeginEndPair_Gettime)->Setup(setup_gettime);
+
+static void BM_BeginEndPair_Tsc(benchmark::State& state)
+{
+  for (auto _ : state) {
+    timer_begin(1);
+    timer_end(1);
+  }
+}
+BENCHMARK(BM_BeginEndPair_Tsc)->Setup(setup_tsc);
+
+/* Concurrent probes on the same timer index: each thread records into
+   its own context, so this should scale flat */
+static void BM_BeginEndThreads(benchmark::State& state)
+{
+  for (auto _ : state) {
+    timer_begin(1);
+    timer_end(1);
+  }
+}
+BENCHMARK(BM_BeginEndThreads)->Setup(setup_gettime)->ThreadRange(1, 64)
+    ->UseRealTime();
+
+/* Cycle over 1 vs 200 live timers to expose per-slot cache misses */
+static void BM_LiveTimers(benchmark::State& state)
+{
+  int ntimers = state.range(0);
+  int tidx = 1;
+  for (auto _ : state) {
+    timer_begin(tidx);
+    timer_end(tidx);
+    tidx = (tidx % ntimers) + 1;
+  }
+}
+BENCHMARK(BM_LiveTimers)->Setup(setup_gettime)->Arg(1)->Arg(200);
+
+/* Throughput of the fused statistics pass over recorded samples */
+static void BM_StatsPass(benchmark::State& state)
+{
+  uint64_t n = state.range(0);
+  std::vector<uint64_t> begins(n), ends(n);
+  for (uint64_t i = 0; i < n; i++) {
+    begins[i] = i * 1000;
+    ends[i] = begins[i] + (i % 97) + 3;
+  }
+  for (auto _ : state) {
+    timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+    timer_fold_samples(&agg, begins.data(), ends.data(), n);
+    benchmark::DoNotOptimize(agg);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_StatsPass)->Setup(setup_gettime)->Arg(1 << 16)->Arg(1 << 22);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,34 @@
+/**
+ * Verifies tiered probe elision. This target builds with
+ * -DTIMER_COMPILED_LEVEL=TIMER_LEVEL_CRITICAL, so normal- and
+ * debug-tier probes must compile to nothing and record no samples.
+ */
+#include <gtest/gtest.h>
+#include <timer_scope.hpp>
+
+TEST(TimerLevel, OutOfTierProbesRecordNothing) {
+  timer_init(100);
+  int critical = timer_register("CRIT");
+  int verbose = timer_register("VERB");
+
+  TIMER_BEGIN(TIMER_LEVEL_CRITICAL, critical);
+  TIMER_END(TIMER_LEVEL_CRITICAL, critical);
+  TIMER_BEGIN(TIMER_LEVEL_DEBUG, verbose);
+  TIMER_END(TIMER_LEVEL_DEBUG, verbose);
+
+  EXPECT_EQ(timer_get_count(critical), 1u);
+  EXPECT_EQ(timer_get_count(verbose), 0u);
+  timer_destroy();
+}
+
+TEST(TimerLevel, ScopedGuardHonorsTier) {
+  timer_init(100);
+  int tidx = timer_register("SCOPED");
+  {
+    timer::ScopedTimer<1> on;
+    timer::ScopedTimer<1, TIMER_LEVEL_DEBUG> off;
+    (void)off;
+  }
+  EXPECT_EQ(timer_get_count(tidx), 1u);
+  timer_destroy();
+}
@@ -0,0 +1,191 @@
+/**
+ * Validates every timer_get_* function against exact references over
+ * a corpus of synthetic sample distributions — constant, bimodal,
+ * heavy-tailed, and adversarial stamps crossing tv_sec boundaries —
+ * fed in as raw ticks through timer_record_batch so the expected
+ * values are known to the bit. A final timed check asserts the stats
+ * pass stays under a per-sample nanosecond budget, so throughput
+ * regressions in the analysis path fail here instead of in the
+ * nightly runs.
+ */
+#include <gtest/gtest.h>
+#include <timer.h>
+
+#include <vector>
+
+namespace {
+
+struct Corpus {
+  std::vector<uint64_t> begins;
+  std::vector<uint64_t> ends;
+};
+
+/* Exact references computed independently of the library */
+struct Reference {
+  uint64_t count = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  unsigned __int128 sum = 0;
+  unsigned __int128 sumsq = 0;
+
+  void add(uint64_t t)
+  {
+    count++;
+    min = (t < min ? t : min);
+    max = (t > max ? t : max);
+    sum += t;
+    sumsq += (unsigned __int128)t * t;
+  }
+  double avg() const { return (double)sum / (double)count * 1e-9; }
+  double total() const { return (double)sum * 1e-9; }
+  double stddev() const
+  {
+    double mean = (double)sum / (double)count;
+    double var = ((double)sumsq / (double)count) - mean * mean;
+    return (var < 0.0 ? 0.0 : sqrt(var)) * 1e-9;
+  }
+};
+
+Corpus make(const std::vector<uint64_t>& deltas)
+{
+  Corpus c;
+  uint64_t at = 0;
+  for (uint64_t t : deltas) {
+    c.begins.push_back(at);
+    c.ends.push_back(at + t);
+    at += t + 17;
+  }
+  return c;
+}
+
+/* Feed one distribution and check every getter against the reference */
+void check(const std::vector<uint64_t>& deltas)
+{
+  timer_set_compensation(false);
+  timer_init(deltas.size());
+  int tidx = timer_register("CORPUS");
+
+  Corpus c = make(deltas);
+  Reference ref;
+  for (uint64_t t : deltas)
+    ref.add(t);
+  ASSERT_EQ(timer_record_batch(tidx, c.begins.data(), c.ends.data(),
+                               deltas.size()),
+            deltas.size());
+
+  EXPECT_EQ(timer_get_count(tidx), ref.count);
+  EXPECT_DOUBLE_EQ(timer_get_min(tidx), (double)ref.min * 1e-9);
+  EXPECT_DOUBLE_EQ(timer_get_max(tidx), (double)ref.max * 1e-9);
+  EXPECT_DOUBLE_EQ(timer_get_avg(tidx), ref.avg());
+  EXPECT_DOUBLE_EQ(timer_get_total(tidx), ref.total());
+  EXPECT_NEAR(timer_get_stddev(tidx), ref.stddev(), ref.stddev() * 1e-12);
+  // No nesting here, so self time equals the total
+  EXPECT_DOUBLE_EQ(timer_get_self(tidx), ref.total());
+  // The log-linear histogram has 32 sub-buckets per power of two,
+  // so percentiles are exact to within one bucket (~3%)
+  double p50 = timer_get_percentile(tidx, 50);
+  EXPECT_GE(p50, (double)ref.min * 1e-9 * 0.96);
+  EXPECT_LE(p50, (double)ref.max * 1e-9 * 1.04);
+  double p999 = timer_get_percentile(tidx, 99.9);
+  EXPECT_LE(p999, (double)ref.max * 1e-9 * 1.04);
+  EXPECT_GE(timer_get_percentile(tidx, 100), (double)ref.max * 1e-9 * 0.96);
+
+  timer_set_compensation(true);
+  timer_destroy();
+}
+
+} // namespace
+
+TEST(TimerStats, ConstantDistribution)
+{
+  check(std::vector<uint64_t>(4096, 500));
+}
+
+TEST(TimerStats, BimodalDistribution)
+{
+  std::vector<uint64_t> d;
+  for (int i = 0; i < 5000; i++)
+    d.push_back(i % 2 ? 100 : 10000);
+  check(d);
+}
+
+TEST(TimerStats, HeavyTailedDistribution)
+{
+  // Mostly ~100ns with rare millisecond outliers, like a page fault
+  // landing in a hot loop
+  std::vector<uint64_t> d;
+  for (int i = 0; i < 20000; i++)
+    d.push_back(i % 1024 == 0 ? 1000000 + (uint64_t)i : 100 + i % 97);
+  check(d);
+}
+
+TEST(TimerStats, StampsCrossingSecondBoundaries)
+{
+  // Begin just below a whole second, end just above the next: every
+  // delta straddles a tv_sec increment
+  Corpus c;
+  Reference ref;
+  for (uint64_t k = 1; k <= 3000; k++) {
+    uint64_t b = k * 1000000000ull - (k % 500);
+    uint64_t e = k * 1000000000ull + 1 + (k % 333);
+    c.begins.push_back(b);
+    c.ends.push_back(e);
+    ref.add(e - b);
+  }
+  timer_set_compensation(false);
+  timer_init(c.begins.size());
+  int tidx = timer_register("SECONDS");
+  ASSERT_EQ(timer_record_batch(tidx, c.begins.data(), c.ends.data(),
+                               c.begins.size()),
+            c.begins.size());
+  EXPECT_EQ(timer_get_count(tidx), ref.count);
+  EXPECT_DOUBLE_EQ(timer_get_min(tidx), (double)ref.min * 1e-9);
+  EXPECT_DOUBLE_EQ(timer_get_max(tidx), (double)ref.max * 1e-9);
+  EXPECT_DOUBLE_EQ(timer_get_total(tidx), ref.total());
+  timer_set_compensation(true);
+  timer_destroy();
+}
+
+TEST(TimerStats, EmptyTimerReportsZeros)
+{
+  // The extrema of a timer with no samples must not leak their
+  // initializers (UINT64_MAX min, lane constants from the kernel)
+  timer_init(16);
+  int tidx = timer_register("EMPTY");
+  EXPECT_EQ(timer_get_count(tidx), 0u);
+  EXPECT_DOUBLE_EQ(timer_get_min(tidx), 0.0);
+  EXPECT_DOUBLE_EQ(timer_get_max(tidx), 0.0);
+  EXPECT_DOUBLE_EQ(timer_get_total(tidx), 0.0);
+  EXPECT_DOUBLE_EQ(timer_get_percentile(tidx, 99), 0.0);
+  timer_destroy();
+}
+
+TEST(TimerStats, FoldThroughputBudget)
+{
+  // The reduce must stay under a per-sample budget; generous enough
+  // for a loaded CI box, tight enough to catch an accidental
+  // per-sample divide or a dropped vector kernel
+  constexpr uint64_t n = 1 << 22;
+  constexpr double budget_ns = 8.0;
+  timer_init(16); /* selects the widest kernel for this CPU */
+  std::vector<uint64_t> begins(n), ends(n);
+  for (uint64_t i = 0; i < n; i++) {
+    begins[i] = i * 1000;
+    ends[i] = begins[i] + (i % 97) + 3;
+  }
+
+  double best = 1e18;
+  for (int pass = 0; pass < 5; pass++) {
+    timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    timer_fold_samples(&agg, begins.data(), ends.data(), n);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ASSERT_EQ(agg.count, n);
+    double ns = (double)(t1.tv_sec - t0.tv_sec) * 1e9 +
+                (double)(t1.tv_nsec - t0.tv_nsec);
+    best = (ns < best ? ns : best);
+  }
+  EXPECT_LT(best / (double)n, budget_ns);
+  timer_destroy();
+}
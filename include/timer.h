@@ -1,10 +1,41 @@
 #ifndef TIMER_H
 #define TIMER_H
 /**
- * A simple timer that uses Linux clock_gettime system call with the 
+ * A simple timer that uses Linux clock_gettime system call with the
  * MONOTONIC_CLOCK to perform nanosecond resolution timing. Timer 0
  * is reserved for measuring the timer overhead.
  *
+ * An alternate TSC backend is available on x86 machines with an
+ * invariant TSC. It reads the cycle counter directly with RDTSC so a
+ * begin/end pair costs single-digit nanoseconds instead of the
+ * 20-30ns of a clock_gettime vDSO call. Select it with
+ * timer_set_backend(TIMER_BACKEND_TSC) before timer_init(); the TSC
+ * is calibrated against CLOCK_MONOTONIC during timer_init().
+ *
+ * Timers are safe to use from multiple threads. Each thread records
+ * into its own timer_ctx (created lazily on first use and registered
+ * with a single lock-free list push), so timer_begin/timer_end never
+ * touch shared state. The per-thread sample arrays are aggregated
+ * when the report is produced at timer_destroy().
+ *
+ * Two recording modes are supported. TIMER_MODE_RECORD (the default)
+ * keeps every raw sample, costing 16 bytes per sample per timer.
+ * TIMER_MODE_STREAM folds each sample into running
+ * count/sum/min/max/sum-of-squares in O(1) space, so arbitrarily long
+ * runs use constant memory at the price of losing the raw samples.
+ * TIMER_MODE_RING keeps the most recent iterations samples in a
+ * power-of-two ring whose write index is masked rather than
+ * bounds-checked, so the hot path stays branch-free and can never
+ * overrun its arrays; full-run totals still come from the running
+ * stream. Select with timer_set_mode() before timer_init().
+ *
+ * The number of timers is unbounded. timer_register() registers a named
+ * timer in a growable registry with an open-addressing hash for
+ * timer_lookup(); unregistered small indices may also be used
+ * directly as before. Each context grows its own slot arrays
+ * geometrically, so timer_begin(idx) on an existing slot is still a
+ * pure array index.
+ *
  * Usage example:
  *
  * timer_init(100);
@@ -13,24 +44,315 @@
  * timer_destroy();
  *
  */
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define TIMER_HAVE_TSC 1
+#endif
+
+/* The header is usable from both C and C++ translation units. C++
+   has no _Atomic or _Thread_local; std::atomic free functions are
+   found by argument-dependent lookup, so the call sites are shared. */
+#ifdef __cplusplus
+#include <atomic>
+#define TIMER_THREAD_LOCAL thread_local
+#else
+#include <stdatomic.h>
+#define TIMER_THREAD_LOCAL _Thread_local
+#endif
 
-#define NUM_TIMERS 6
 #define MAX_NAME_SIZE 16
+/* Initial number of timer slots; grows geometrically on demand */
+#define TIMER_INIT_SLOTS 8
+/* Maximum nesting depth of active timers per thread */
+#define TIMER_STACK_DEPTH 32
+
+/* Clock backends for timer_begin/timer_end */
+#define TIMER_BACKEND_GETTIME 0
+#define TIMER_BACKEND_TSC 1
+
+/* Per-timer clock attributes in the registry (timer_register_clock):
+   DEFAULT inherits the global backend; TSC marks a slot that stamps
+   with RDTSC */
+#define TIMER_CLOCK_DEFAULT ((clockid_t)-1)
+#define TIMER_CLOCK_TSC ((clockid_t)-2)
+
+/* Recording modes */
+#define TIMER_MODE_RECORD 0
+#define TIMER_MODE_STREAM 1
+#define TIMER_MODE_RING 2
+
+/* Background flush sink formats */
+/* Buffered report formats (timer_write_report) */
+#define TIMER_REPORT_TSV 0
+#define TIMER_REPORT_CSV 1
+#define TIMER_REPORT_JSONL 2
+
+#define TIMER_FLUSH_TSV 0
+#define TIMER_FLUSH_BINARY 1
+
+/* Freelist terminator for the cross-thread span pool */
+#define TIMER_SPAN_NONE 0xffffffffu
+
+/* Instrumentation tiers. Probes carry a tier and are compiled in
+   only when their tier is at or below TIMER_COMPILED_LEVEL, which a
+   build target may override (e.g. -DTIMER_COMPILED_LEVEL=0 ships only
+   critical probes). Out-of-tier probes constant-fold to nothing. */
+#define TIMER_LEVEL_CRITICAL 0
+#define TIMER_LEVEL_NORMAL 1
+#define TIMER_LEVEL_DEBUG 2
+#ifndef TIMER_COMPILED_LEVEL
+#define TIMER_COMPILED_LEVEL TIMER_LEVEL_DEBUG
+#endif
+
+/* Tiered probes: both arguments are compile-time constants in the
+   intended usage, so a disabled tier leaves no instructions behind */
+#define TIMER_BEGIN(level, tidx) \
+  do {                           \
+    if ((level) <= TIMER_COMPILED_LEVEL) \
+      timer_begin(tidx);         \
+  } while (0)
+#define TIMER_END(level, tidx)   \
+  do {                           \
+    if ((level) <= TIMER_COMPILED_LEVEL) \
+      timer_end(tidx);           \
+  } while (0)
+
+/* HDR-style log-linear histogram geometry: 32 linear sub-buckets per
+   power-of-two range, covering the full 64-bit tick range in a fixed
+   1920-bucket array so timer_end updates stay O(1) and in cache */
+#define TIMER_HIST_SUB_BITS 5
+#define TIMER_HIST_SUB (1u << TIMER_HIST_SUB_BITS)
+#define TIMER_HIST_BUCKETS ((64 - TIMER_HIST_SUB_BITS + 1) * TIMER_HIST_SUB)
+
+/* Binary trace file: a timer_trace_header followed by one section per
+   timer of [name, sample count, raw 64-bit tick deltas]. Written by
+   timer_write_trace and read back with the timer_trace_* API. */
+#define TIMER_TRACE_MAGIC 0x524d4954u /* "TIMR" little-endian */
+#define TIMER_TRACE_VERSION 1
+
+typedef struct timer_trace_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ntimers;
+  uint32_t name_size;
+  double sec_per_tick;
+} timer_trace_header;
+
+/* A reader's view of an open trace file */
+typedef struct timer_trace {
+  void* map;
+  size_t size;
+  timer_trace_header* hdr;
+} timer_trace;
+
+/* Compressed archive file: durations stored as zigzag-varint deltas
+   from the previous duration, in frames of TIMER_PACK_FRAME samples.
+   Every frame restarts the predictor, so readers can seek to a frame
+   using the per-frame byte counts without decoding what precedes it. */
+#define TIMER_PACK_MAGIC 0x504d4954u /* "TIMP" little-endian */
+#define TIMER_PACK_VERSION 1
+#define TIMER_PACK_FRAME 4096
+
+typedef struct timer_pack_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ntimers;
+  uint32_t name_size;
+  double sec_per_tick;
+} timer_pack_header;
+
+/* A reader's view of an open pack file */
+typedef struct timer_pack {
+  void* map;
+  size_t size;
+  timer_pack_header* hdr;
+} timer_pack;
+
+/* Running statistics folded up by timer_end in TIMER_MODE_STREAM */
+typedef struct timer_stream {
+  uint64_t count;
+  unsigned __int128 sum;   /* 128-bit: century-scale totals stay exact */
+  uint64_t min;
+  uint64_t max;
+  unsigned __int128 sumsq; /* sum of squared tick deltas */
+} timer_stream;
+
+/* A cross-thread span drawn from the lock-free pool: begun on one
+   thread, completed on any other */
+typedef struct timer_span {
+  uint64_t begin;
+  int tidx;
+  uint32_t next; /* pool index of the next free span */
+} timer_span;
+
+/* Per-timer control block. Aligned to the cache line size so
+   adjacent timers never share a line, and ordered so the fields
+   timer_end touches (current, pending, array pointers, stream) sit
+   together at the front of the block. */
+/* Cross-process shared segment (timer_init_shm): a header followed by
+   TIMER_SHM_REGIONS fixed regions of TIMER_SHM_SLOTS slots each. A
+   context claims a whole region with one fetch-add at creation, so
+   after startup no two processes ever write the same cache line and
+   no cross-process atomics run on the hot path. */
+#define TIMER_SHM_MAGIC 0x534d4954u /* "TIMS" */
+#define TIMER_SHM_REGIONS 64
+#define TIMER_SHM_SLOTS 64
+
+typedef struct timer_shm_head {
+  uint32_t magic;
+  uint32_t mode;
+  uint64_t iterations;
+  double sec_per_tick;
+  char names[TIMER_SHM_SLOTS][MAX_NAME_SIZE];
+#ifdef __cplusplus
+  std::atomic<uint32_t> claimed;
+#else
+  _Atomic uint32_t claimed;
+#endif
+} timer_shm_head;
+
+/* One shared slot: published cursor and running stats, followed in
+   the segment by the begin/end sample arrays in record/ring mode */
+typedef struct timer_shm_slot {
+  uint64_t count;
+  timer_stream stream;
+} timer_shm_slot;
+
+typedef struct timer_slot {
+  uint64_t current;
+  uint64_t pending;           /* begin stamp in streaming mode */
+  uint64_t calls;             /* invocations seen, for 1-in-N sampling */
+  uint64_t* begins;
+  uint64_t* ends;
+  uint64_t* hist;             /* TIMER_HIST_BUCKETS bucket counts */
+  uint64_t* begins2;          /* shadow buffers the flusher swaps in */
+  uint64_t* ends2;
+  uint64_t child;             /* ticks spent in nested child timers */
+  timer_stream stream;
+  uint64_t mark;              /* cursor snapshot at timer_epoch_begin */
+  timer_stream mark_stream;   /* stream snapshot at timer_epoch_begin */
+  timer_shm_slot* shm;        /* shared twin of this slot, or NULL */
+  clockid_t clk;              /* clock this slot stamps with */
+} __attribute__((aligned(64))) timer_slot;
+
+/* One mmap'd block of a context's storage arena. Sample, shadow, and
+   histogram arrays are carved out of these, so the library's
+   footprint shows up in memory accounting as a handful of mappings
+   instead of thousands of heap chunks, and each block is released
+   with a single munmap at destroy. */
+typedef struct timer_arena {
+  unsigned char* base;
+  size_t size;
+  size_t used;
+  struct timer_arena* next;
+} timer_arena;
 
-static struct timespec* timer_begins_by_idx[NUM_TIMERS];
-static struct timespec* timer_ends_by_idx[NUM_TIMERS];
-static int timer_current_by_idx[NUM_TIMERS];
-static char timer_names[NUM_TIMERS][MAX_NAME_SIZE];
+/* Per-thread timer state. Every thread that calls timer_begin gets
+   its own context, so the hot path is free of locks and sharing. The
+   slot array is sized to nslots and grown geometrically by the owning
+   thread when a larger timer index is first used. */
+typedef struct timer_ctx {
+  int nslots;
+  timer_slot* slots;
+  timer_arena* arena;
+  uint32_t shm_region;        /* 1-based claimed shm region; 0 = private */
+  /* Stack of active timers for parent/child attribution. Fixed depth
+     so push/pop never allocates on the hot path. */
+  int stack[TIMER_STACK_DEPTH];
+  int depth;
+  struct timer_ctx* next;
+} timer_ctx;
+
+#ifdef __cplusplus
+static std::atomic<timer_ctx*> timer_ctx_list(NULL);
+#else
+static timer_ctx* _Atomic timer_ctx_list = NULL;
+#endif
+static TIMER_THREAD_LOCAL timer_ctx* timer_tls = NULL;
+static size_t timer_iterations = 0;
+static uint64_t timer_ring_mask = 0; /* ring capacity - 1 in ring mode */
+
+/* Timer name registry: a growable slot table plus an open-addressing
+   hash on name for timer_lookup(). Registration happens at startup;
+   the hot path never touches the registry. */
+static char (*timer_names)[MAX_NAME_SIZE] = NULL;
+static int timer_name_slots = 0;
 static int timer_name_cur = 0;
+static int* timer_hash_tab = NULL;  /* slots hold timer idx or -1 */
+static size_t timer_hash_cap = 0;   /* power of two */
+
+static int timer_backend = TIMER_BACKEND_GETTIME;
+static int timer_mode = TIMER_MODE_RECORD;
+/* Back arena blocks with huge pages (timer_set_hugepages) */
+static bool timer_use_huge = false;
+/* Sampling interval minus one; 0 records every invocation */
+static uint64_t timer_sample_mask = 0;
+/* Per-timer clock attribute, parallel to timer_names */
+static clockid_t* timer_clock_ids = NULL;
+/* Shared segment mapped by timer_init_shm (writer side) */
+static void* timer_shm_base = NULL;
+static size_t timer_shm_size = 0;
+static int timer_shm_fd = -1;
+/* Read-only aggregator mapping (timer_shm_attach) */
+static void* timer_shm_agg = NULL;
+static size_t timer_shm_agg_size = 0;
+/* Cached fused-pass statistics, keyed by sample count at gather time */
+static timer_stream* timer_stats_cache = NULL;
+static size_t* timer_stats_count = NULL;
+static bool* timer_stats_valid = NULL;
+static int timer_stats_slots = 0;
+/* Seconds per raw tick; 1e-9 for the gettime backend, calibrated for TSC */
+static double timer_sec_per_tick = 1e-9;
+/* Median probe overhead in ticks, measured by the CLCK loop at the
+   end of timer_init(); subtracted from reported durations */
+static uint64_t timer_overhead_ticks = 0;
+static bool timer_compensate = true;
+
+/* Cross-thread span pool: preallocated slots linked through a
+   lock-free freelist. The head carries a generation tag in its upper
+   32 bits so concurrent pop/push cannot ABA. */
+static timer_span* timer_span_pool = NULL;
+static int timer_span_slots = 1024;
+#ifdef __cplusplus
+static std::atomic<uint64_t> timer_span_free(TIMER_SPAN_NONE);
+#else
+static _Atomic uint64_t timer_span_free = TIMER_SPAN_NONE;
+#endif
+
+/* Background flusher state */
+static pthread_t timer_flush_thread;
+static volatile int timer_flush_running = 0;
+static FILE* timer_flush_file = NULL;
+static int timer_flush_format = TIMER_FLUSH_TSV;
+static double timer_flush_interval = 1.0;
+static uint64_t timer_flush_epoch = 0;
+
+/* Watchdog state: the signal handler only flips the flag */
+static pthread_t timer_watch_thread;
+static volatile int timer_watch_running = 0;
+static volatile sig_atomic_t timer_watch_fire = 0;
+static FILE* timer_watch_file = NULL;
 
 /**
    Initializes timer storage to hold n iterations
-   @param iterations number of timer samples to support
+   @param iterations number of timer samples to support per thread
 */
 int timer_init(size_t iterations);
 
@@ -39,11 +361,147 @@ int timer_init(size_t iterations);
 */
 int timer_destroy();
 
+/**
+   Initialize like timer_init, but place all sample storage in the
+   POSIX shared-memory segment name so a companion aggregator can
+   compute cluster-wide statistics across every worker process mapping
+   the same name. Call instead of timer_init; the background flusher
+   is not supported in this mode. The first TIMER_SHM_SLOTS timers of
+   the first TIMER_SHM_REGIONS contexts live in the segment; anything
+   beyond falls back to private storage.
+   @return 0 on success, -1 if the segment cannot be created
+*/
+int timer_init_shm(const char* name, size_t iterations);
+
+/**
+   Publish every context's cursors and running stats to the shared
+   segment. Record-mode cursors are already published on each
+   timer_end; this completes the picture for whatever changed since.
+   Called automatically by timer_destroy.
+   @return 0, or -1 when not in shared-memory mode
+*/
+int timer_shm_publish();
+
+/**
+   Map the shared segment name read-only for aggregation. Safe to call
+   from a process that never calls timer_init.
+   @return 0 on success, -1 on a missing or foreign segment
+*/
+int timer_shm_attach(const char* name);
+
+/**
+   Reduce one timer across every claimed region of the attached
+   segment, straight from the mapping with zero copies.
+   @return the merged statistics in raw ticks
+*/
+timer_stream timer_shm_stats(int tidx);
+
+/**
+   Print cluster-wide per-timer summaries from the attached segment
+   @return 0, or -1 when no segment is attached
+*/
+int timer_shm_print_tsv();
+
+/**
+   Unmap the segment mapped by timer_shm_attach
+*/
+int timer_shm_detach();
+
+/**
+   Select the clock backend (TIMER_BACKEND_GETTIME or
+   TIMER_BACKEND_TSC). Must be called before timer_init(). Falls back
+   to the gettime backend when the machine has no invariant TSC.
+   @return the backend actually selected
+*/
+int timer_set_backend(int backend);
+
+/**
+   Select the recording mode (TIMER_MODE_RECORD or TIMER_MODE_STREAM).
+   Must be called before timer_init().
+   @return the mode selected
+*/
+int timer_set_mode(int mode);
+
+/**
+   Register a named timer in the registry
+   @return the new timer's index
+*/
+int timer_register(const char* name);
+
+/**
+   Register a named timer that stamps with its own clock instead of
+   the global backend: CLOCK_THREAD_CPUTIME_ID separates on-CPU time
+   from wall time, CLOCK_MONOTONIC_COARSE drops the probe to a memory
+   read where ~4ms resolution is enough. The clockid is stored in the
+   timer's slot and handed straight to clock_gettime, so mixing clocks
+   in one report adds no dispatch beyond the slot load the probe
+   already does. Custom clocks tick in nanoseconds even when the
+   global backend is the TSC. Set clocks before probing starts.
+   @return the new timer's index
+*/
+int timer_register_clock(const char* name, clockid_t clock);
+
+/**
+   @return the index registered for name, or -1 if name is unknown
+*/
+int timer_lookup(const char* name);
+
 /**
    @return the timer index associated with name
 */
 int timer_set_name(char* name);
 
+/**
+   Set the size of the cross-thread span pool. Must be called before
+   timer_init().
+   @return the pool size selected
+*/
+int timer_set_spans(int nspans);
+
+/**
+   Record only every Nth begin/end invocation per timer, for paths too
+   hot to record in full. n is rounded up to a power of two so the
+   skip path is a counter increment, a mask, and a predictable branch.
+   Totals reported by timer_get_total and timer_get_self (and their
+   TSV columns) are scaled back up by the sampling factor; averages,
+   extrema and percentiles describe the recorded subsample. Pass 1 to
+   disable.
+   @return the sampling interval selected
+*/
+int timer_set_sampling(int n);
+
+/**
+   Enable or disable probe-overhead compensation. When enabled (the
+   default), the median of timer 0's CLCK calibration distribution is
+   subtracted from every duration reported by the timer_get_* getters
+   and timer_print_tsv, so sub-microsecond regions are not inflated by
+   the cost of the end-side clock read. The median resists the
+   preempted calibration iterations that would dominate a mean.
+   @return the setting selected
+*/
+bool timer_set_compensation(bool enabled);
+
+/**
+   Request huge-page backing for the per-context storage arenas, so
+   the sample arrays cost one dTLB entry per 2MB instead of per 4KB.
+   Must be called before timer_init(). Silently falls back to normal
+   pages when the huge-page pool is empty.
+   @return the setting selected
+*/
+bool timer_set_hugepages(bool enabled);
+
+/**
+   Begin a span that may be completed by another thread
+   @return a span handle, or -1 if the pool is exhausted
+*/
+static inline int timer_span_begin(int tidx);
+
+/**
+   Complete a span begun with timer_span_begin, attributing the
+   elapsed time to the completing thread's context
+*/
+static inline int timer_span_end(int handle);
+
 /**
    Start the timer
 */
@@ -54,6 +512,22 @@ static inline int timer_begin(int tidx);
 */
 static inline int timer_end(int tidx);
 
+/**
+   Bulk-append n externally captured begin/end pairs to timer tidx,
+   in the active backend's raw ticks. Record mode memcpys the pairs
+   (bounded by the remaining capacity); streaming and ring modes fold
+   them through the vectorized statistics kernel. The histogram is
+   updated for every ingested sample.
+   @return the number of samples ingested
+*/
+size_t timer_record_batch(int tidx, const uint64_t* begins,
+                          const uint64_t* ends, size_t n);
+
+/**
+   @return the number of samples stored for timer tidx across all threads
+*/
+size_t timer_get_count(int tidx);
+
 /**
    @return the average of all times stored for timer tidx
 */
@@ -74,137 +548,2071 @@ double timer_get_min(int tidx);
 */
 double timer_get_total(int tidx);
 
+/**
+   @return the standard deviation of all times stored for timer tidx
+*/
+double timer_get_stddev(int tidx);
+
+/**
+   @return the self time of timer tidx: its total minus the time
+           spent in timers nested inside it
+*/
+double timer_get_self(int tidx);
+
+/**
+   @param p percentile in [0, 100], e.g. 99.9 for p999
+   @return the p-th percentile of all times stored for timer tidx,
+           read from the per-timer latency histogram
+*/
+double timer_get_percentile(int tidx, double p);
+
 /**
    Prints the timer as a TSV list
    @return 0
 */
 int timer_print_tsv(int tidx, bool header);
 
+/**
+   Open a measurement phase: snapshot every timer's cursors in
+   O(timers) so the phase can later be reported in isolation. No
+   sample data is copied or reset, so warmup/steady-state/cooldown
+   phases run back to back in one process and earlier phases never
+   pollute a later phase's min/max. Beginning a new epoch replaces the
+   current one.
+*/
+int timer_epoch_begin(const char* label);
+
+/**
+   Close the phase opened by timer_epoch_begin and print one TSV
+   summary row per timer covering only the samples recorded during the
+   phase. Phase min/max come from the retained raw samples, so the
+   streaming mode reports count/avg/total only.
+   @return 0, or -1 if no epoch is open
+*/
+int timer_epoch_end();
+
+/**
+   Start the background flusher: a low-priority thread that every
+   interval_sec swaps each timer's sample buffers, streams the retired
+   epoch to path, and resets the per-epoch counts so long-running
+   services keep constant memory. format is TIMER_FLUSH_TSV (one
+   summary row per timer per epoch) or TIMER_FLUSH_BINARY (epoch
+   records of raw tick deltas).
+   @return 0 on success, -1 if the sink cannot be opened
+*/
+int timer_flush_start(const char* path, int format, double interval_sec);
+
+/**
+   Stop the background flusher, emitting one final epoch
+*/
+int timer_flush_stop();
+
+/**
+   Start the watchdog: after this, `kill -USR2 <pid>` appends the
+   current per-timer TSV summaries to path ("-" or NULL for stderr)
+   while the service keeps running — no need to wait for the exit
+   report or attach a debugger. The SIGUSR2 handler only sets a flag;
+   a helper thread produces the report through the same lock-free
+   gather every report uses, so neither side ever takes a lock
+   timer_end could contend on.
+   @return 0 on success, -1 if the sink cannot be opened
+*/
+int timer_watchdog_start(const char* path);
+
+/**
+   Stop the watchdog and restore the default SIGUSR2 disposition
+*/
+int timer_watchdog_stop();
+
+/**
+   Write the full report for every active timer to path ("-" for
+   stdout) with one write() call. Rows are formatted into a single
+   buffer with a two-significant-digit float routine instead of
+   printf, so reports over hundreds of timers take milliseconds, not
+   seconds. format selects TIMER_REPORT_TSV (the timer_print_tsv
+   shape), TIMER_REPORT_CSV, or TIMER_REPORT_JSONL (one JSON object
+   per timer, ready for a log shipper).
+   @return 0 on success, -1 if the sink cannot be opened
+*/
+int timer_write_report(const char* path, int format);
+
+/**
+   Write every timer's raw samples to a binary trace file. The file is
+   sized with ftruncate and filled through a single mmap, so the
+   sample deltas go straight from the recording arrays to the page
+   cache with no formatting. Only TIMER_MODE_RECORD keeps raw samples;
+   in streaming mode the per-timer sections are empty.
+   @return 0 on success, -1 on I/O failure
+*/
+int timer_write_trace(const char* path);
+
+/**
+   Map a binary trace file for reading
+   @return 0 on success, -1 on open/validation failure
+*/
+int timer_trace_open(const char* path, timer_trace* trace);
+
+/**
+   @return the number of timer sections in an open trace
+*/
+int timer_trace_timers(const timer_trace* trace);
+
+/**
+   @return the name recorded for timer tidx in an open trace
+*/
+const char* timer_trace_name(const timer_trace* trace, int tidx);
+
+/**
+   @param count out-parameter receiving the sample count
+   @return a pointer into the mapping at timer tidx's tick deltas
+*/
+const uint64_t* timer_trace_samples(const timer_trace* trace, int tidx,
+                                    uint64_t* count);
+
+/**
+   Unmap a trace opened with timer_trace_open
+*/
+int timer_trace_close(timer_trace* trace);
+
+/**
+   Write every timer's raw durations to a delta-compressed archive.
+   Durations of adjacent samples are near-identical in steady state,
+   so the zigzag-varint encoded deltas are typically one byte each
+   versus 16 bytes for a raw begin/end pair.
+   @return 0 on success, -1 on I/O failure
+*/
+int timer_write_pack(const char* path);
+
+/**
+   Map a compressed archive for reading
+   @return 0 on success, -1 on open/validation failure
+*/
+int timer_pack_open(const char* path, timer_pack* pack);
+
+/**
+   @return the number of timer sections in an open archive
+*/
+int timer_pack_timers(const timer_pack* pack);
+
+/**
+   @return the name recorded for timer tidx in an open archive
+*/
+const char* timer_pack_name(const timer_pack* pack, int tidx);
+
+/**
+   @return the total duration count stored for timer tidx
+*/
+uint64_t timer_pack_count(const timer_pack* pack, int tidx);
+
+/**
+   Reconstruct up to max durations (raw ticks) for timer tidx into
+   out; feed them back through timer_record_batch (with zero begins)
+   to reuse the statistics functions on archived data.
+   @return the number of durations decoded
+*/
+size_t timer_pack_decode(const timer_pack* pack, int tidx, uint64_t* out,
+                         size_t max);
+
+/**
+   Unmap an archive opened with timer_pack_open
+*/
+int timer_pack_close(timer_pack* pack);
+
 /* ------------------------ Begin Implementations --------------------- */
 
-int timer_init(size_t iterations)
+/* Read the active clock as raw ticks (nanoseconds for gettime,
+   cycles for TSC) */
+static inline uint64_t timer_raw_now()
 {
-  // Create the timer arrays
-  for (int i = 0; i < NUM_TIMERS; i++) {
-    /* Initialize the name to just be integers */
-    char name[MAX_NAME_SIZE] = {'\0'};
-    snprintf(name, MAX_NAME_SIZE - 1, "%d", i);
+#ifdef TIMER_HAVE_TSC
+  if (timer_backend == TIMER_BACKEND_TSC)
+    return __rdtsc();
+#endif
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((uint64_t)t.tv_sec * 1000000000ull) + (uint64_t)t.tv_nsec;
+}
 
-    /* Create the arrays */
-    timer_begins_by_idx[i] = calloc(iterations, sizeof(struct timespec));
-    timer_ends_by_idx[i] = calloc(iterations, sizeof(struct timespec));
-    timer_current_by_idx[i] = 0;
-    strncpy(timer_names[i], name, MAX_NAME_SIZE);
-  }
+/* Convert a raw tick delta into seconds */
+static inline double timer_raw_to_sec(uint64_t ticks)
+{
+  return (double)ticks * timer_sec_per_tick;
+}
 
-  // Use timer 0 to measure the timer overhead
-  int clk = timer_set_name("CLCK");
-  struct timespec t;
-  for (int i = 0; i < iterations; i++) {
-    timer_begin(clk);
-    clock_gettime(CLOCK_MONOTONIC, &t);
-    timer_end(clk);
-  }
-  return 0;
+/* Stamp with the slot's own clock: custom clocks go straight to
+   clock_gettime with the stored clockid, default slots keep the
+   backend's path */
+static inline uint64_t timer_slot_now(const timer_slot* slot)
+{
+#ifdef TIMER_HAVE_TSC
+  if (slot->clk == TIMER_CLOCK_TSC)
+    return __rdtsc();
+#endif
+  struct timespec ts;
+  clock_gettime(slot->clk, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
 }
 
-int timer_destroy() {
-  // Print the timer arrays and deallocate resources
-  timer_print_tsv(0, true);
-  free(timer_begins_by_idx[0]);
-  free(timer_ends_by_idx[0]);
-  
-  for (int i = 1; i < NUM_TIMERS; i++) {
-    if (0 < timer_current_by_idx[i]) {
-      timer_print_tsv(i, false);
-    }
-    free(timer_begins_by_idx[i]);
-    free(timer_ends_by_idx[i]);
+/* Seconds per tick for timer tidx; custom-clock timers tick in
+   nanoseconds regardless of the global backend */
+static inline double timer_tick_rate(int tidx)
+{
+  if (timer_clock_ids != NULL && tidx < timer_name_slots
+      && timer_clock_ids[tidx] != TIMER_CLOCK_DEFAULT)
+    return 1e-9;
+  return timer_sec_per_tick;
+}
+
+/* Convert a measured duration to seconds with the median probe
+   overhead subtracted (clamped at zero) */
+static inline double timer_comp_to_sec(double ticks, double rate)
+{
+  double sec = ticks * rate;
+  double ovh = (timer_compensate
+                    ? (double)timer_overhead_ticks * timer_sec_per_tick
+                    : 0.0);
+  return (sec > ovh ? sec - ovh : 0.0);
+}
+
+#ifdef TIMER_HAVE_TSC
+/* Check CPUID leaf 0x80000007 EDX bit 8 for an invariant TSC */
+static int timer_tsc_is_invariant()
+{
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return (edx & (1u << 8)) != 0;
+}
+
+/* Measure TSC frequency against CLOCK_MONOTONIC over a short window */
+static double timer_tsc_calibrate()
+{
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  uint64_t c0 = __rdtsc();
+  do {
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+  } while (((t1.tv_sec - t0.tv_sec) * 1000000000ll +
+            (t1.tv_nsec - t0.tv_nsec)) < 2000000ll);
+  uint64_t c1 = __rdtsc();
+  double elapsed = (double)(t1.tv_sec - t0.tv_sec) +
+                   ((double)(t1.tv_nsec - t0.tv_nsec) / 1000000000);
+  return elapsed / (double)(c1 - c0);
+}
+#endif
+
+/* Pre-fault a buffer one write per page. mmap hands back untouched
+   zero pages; touching them here, on the thread that owns the
+   context, places them on that thread's local NUMA node (first-touch
+   policy) and keeps the page faults out of the probes. */
+static void timer_first_touch(uint64_t* buf, size_t n)
+{
+  volatile uint64_t* p = buf;
+  for (size_t i = 0; i < n; i += 4096 / sizeof(uint64_t))
+    p[i] = 0;
+}
+
+/* Arena bytes one slot carves, in 64-byte-aligned cuts */
+static size_t timer_slot_bytes()
+{
+  size_t b = (TIMER_HIST_BUCKETS * sizeof(uint64_t) + 63) & ~(size_t)63;
+  if (timer_mode == TIMER_MODE_RECORD || timer_mode == TIMER_MODE_RING)
+    b += 4 * ((timer_iterations * sizeof(uint64_t) + 63) & ~(size_t)63);
+  return b;
+}
+
+/* Map one arena block, preferring huge pages when requested so the
+   hot sample arrays stop thrashing the dTLB; falls back to normal
+   pages when the huge-page pool is empty. */
+static timer_arena* timer_arena_map(size_t bytes)
+{
+  timer_arena* a = (timer_arena*)calloc(1, sizeof(timer_arena));
+  bytes = (bytes + 4095) & ~(size_t)4095;
+  void* base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (timer_use_huge) {
+    size_t huge = (bytes + ((size_t)2 << 20) - 1) & ~(((size_t)2 << 20) - 1);
+    base = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base != MAP_FAILED)
+      bytes = huge;
   }
-  return 0;
+#endif
+  if (base == MAP_FAILED)
+    base = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  a->base = (unsigned char*)base;
+  a->size = bytes;
+  return a;
 }
 
-int timer_set_name(char* name) {
-  memset(timer_names[timer_name_cur], '\0', MAX_NAME_SIZE);
-  strncpy(timer_names[timer_name_cur], name, MAX_NAME_SIZE - 1);
-  return timer_name_cur++;
+/* Make sure the context's arena can carve bytes more; each growth
+   generation reserves exactly what its new slots need, in one mmap */
+static void timer_arena_reserve(timer_ctx* ctx, size_t bytes)
+{
+  if (ctx->arena && ctx->arena->size - ctx->arena->used >= bytes)
+    return;
+  timer_arena* a = timer_arena_map(bytes);
+  a->next = ctx->arena;
+  ctx->arena = a;
 }
 
-static double timespec_to_double(struct timespec* t)
+/* Carve n uint64s from the context's arena, 64-byte aligned */
+static uint64_t* timer_arena_alloc(timer_ctx* ctx, size_t n)
 {
-  double seconds = t->tv_sec;
-  double nanos = t->tv_nsec;
-  return (seconds + (nanos / 1000000000 ));
+  size_t bytes = (n * sizeof(uint64_t) + 63) & ~(size_t)63;
+  uint64_t* p = (uint64_t*)(ctx->arena->base + ctx->arena->used);
+  ctx->arena->used += bytes;
+  return p;
 }
 
-int timer_begin(int tidx)
+/* Shared-segment layout: 64-byte-aligned cuts, like the arena */
+static size_t timer_shm_arr_words(uint64_t iterations)
 {
-  return clock_gettime(CLOCK_MONOTONIC, (timer_begins_by_idx[tidx] + timer_current_by_idx[tidx]));
+  return ((iterations * sizeof(uint64_t) + 63) & ~(size_t)63)
+         / sizeof(uint64_t);
 }
 
-int timer_end(int tidx)
+static size_t timer_shm_slot_stride(uint64_t iterations, uint32_t mode)
 {
-  clock_gettime(CLOCK_MONOTONIC, (timer_ends_by_idx[tidx] + timer_current_by_idx[tidx]));
-  timer_current_by_idx[tidx]++;
-  return 0;
+  size_t b = (sizeof(timer_shm_slot) + 63) & ~(size_t)63;
+  if (mode == TIMER_MODE_RECORD || mode == TIMER_MODE_RING)
+    b += 2 * timer_shm_arr_words(iterations) * sizeof(uint64_t);
+  return b;
 }
 
-double timer_get_avg(int tidx)
+static size_t timer_shm_segment_bytes(uint64_t iterations, uint32_t mode)
 {
-  return (timer_get_total(tidx) / timer_current_by_idx[tidx]);
+  size_t head = (sizeof(timer_shm_head) + 4095) & ~(size_t)4095;
+  return head + (size_t)TIMER_SHM_REGIONS * TIMER_SHM_SLOTS
+                    * timer_shm_slot_stride(iterations, mode);
 }
 
-double timer_get_max(int tidx)
+static timer_shm_slot* timer_shm_slot_at(void* base, uint32_t region,
+                                         int tidx)
+{
+  timer_shm_head* h = (timer_shm_head*)base;
+  size_t head = (sizeof(timer_shm_head) + 4095) & ~(size_t)4095;
+  return (timer_shm_slot*)((unsigned char*)base + head
+                           + ((size_t)region * TIMER_SHM_SLOTS + tidx)
+                                 * timer_shm_slot_stride(h->iterations,
+                                                         h->mode));
+}
+
+static uint64_t* timer_shm_slot_begins(timer_shm_slot* ss)
+{
+  return (uint64_t*)((unsigned char*)ss
+                     + ((sizeof(timer_shm_slot) + 63) & ~(size_t)63));
+}
+
+/* Initialize one per-timer slot in a context */
+static void timer_slot_init(timer_ctx* ctx, timer_slot* slot, int tidx)
 {
-  double begin = timespec_to_double(timer_begins_by_idx[tidx]);
-  double end = timespec_to_double(timer_ends_by_idx[tidx]);
-  double max = end - begin;
-  for (int i = 0; i <  timer_current_by_idx[tidx]; i++) {
-    begin = timespec_to_double(timer_begins_by_idx[tidx] + i);
-    end = timespec_to_double(timer_ends_by_idx[tidx] + i);
-    double t = end - begin;
-    max = (t > max ? t : max);
+  memset(slot, 0, sizeof(timer_slot));
+  slot->clk = (timer_clock_ids != NULL && tidx < timer_name_slots
+               && timer_clock_ids[tidx] != TIMER_CLOCK_DEFAULT)
+                  ? timer_clock_ids[tidx]
+                  : (timer_backend == TIMER_BACKEND_TSC ? TIMER_CLOCK_TSC
+                                                        : CLOCK_MONOTONIC);
+  if (ctx->shm_region && tidx < TIMER_SHM_SLOTS)
+    slot->shm = timer_shm_slot_at(timer_shm_base, ctx->shm_region - 1, tidx);
+  if (timer_mode == TIMER_MODE_RECORD || timer_mode == TIMER_MODE_RING) {
+    if (slot->shm) {
+      // Samples live directly in this context's region of the shared
+      // segment; the flusher's shadow buffers stay NULL
+      slot->begins = timer_shm_slot_begins(slot->shm);
+      slot->ends = slot->begins + timer_shm_arr_words(timer_iterations);
+    } else {
+      slot->begins = timer_arena_alloc(ctx, timer_iterations);
+      slot->ends = timer_arena_alloc(ctx, timer_iterations);
+      slot->begins2 = timer_arena_alloc(ctx, timer_iterations);
+      slot->ends2 = timer_arena_alloc(ctx, timer_iterations);
+      timer_first_touch(slot->begins2, timer_iterations);
+      timer_first_touch(slot->ends2, timer_iterations);
+    }
+    timer_first_touch(slot->begins, timer_iterations);
+    timer_first_touch(slot->ends, timer_iterations);
   }
-  return max;
+  slot->hist = timer_arena_alloc(ctx, TIMER_HIST_BUCKETS);
+  timer_first_touch(slot->hist, TIMER_HIST_BUCKETS);
+  slot->stream.min = UINT64_MAX;
 }
 
-double timer_get_min(int tidx)
+/* Grow a context's slot array geometrically so tidx is valid. Only
+   the owning thread ever resizes its context, so no locking is
+   needed; readers on the gather path bound themselves by nslots.
+   aligned_alloc keeps the cache-line alignment realloc would lose. */
+static void timer_ctx_grow(timer_ctx* ctx, int tidx)
+{
+  int slots = (ctx->nslots > 0 ? ctx->nslots : TIMER_INIT_SLOTS);
+  while (slots <= tidx)
+    slots *= 2;
+
+  timer_slot* grown = (timer_slot*)aligned_alloc(64, slots * sizeof(timer_slot));
+  if (ctx->nslots > 0)
+    memcpy(grown, ctx->slots, ctx->nslots * sizeof(timer_slot));
+  // Shared-backed slots only need arena space for their histogram
+  size_t hist = (TIMER_HIST_BUCKETS * sizeof(uint64_t) + 63) & ~(size_t)63;
+  size_t reserve = 0;
+  for (int i = ctx->nslots; i < slots; i++)
+    reserve += (ctx->shm_region && i < TIMER_SHM_SLOTS)
+                   ? hist
+                   : timer_slot_bytes();
+  timer_arena_reserve(ctx, reserve);
+  for (int i = ctx->nslots; i < slots; i++)
+    timer_slot_init(ctx, &grown[i], i);
+  free(ctx->slots);
+  ctx->slots = grown;
+  ctx->nslots = slots;
+}
+
+/* Create this thread's context and push it onto the global list.
+   Because each thread allocates and first-touches its own buffers,
+   sample storage is naturally sharded per executing CPU and resides
+   on the caller's local NUMA node — a thread on the remote socket
+   never writes another thread's lines inside a probe. */
+static timer_ctx* timer_ctx_create()
 {
-  double begin = timespec_to_double(timer_begins_by_idx[tidx]);
-  double end = timespec_to_double(timer_ends_by_idx[tidx]);  
-  double min = end - begin;
-  for (int i = 0; i <  timer_current_by_idx[tidx]; i++) {
-    begin = timespec_to_double(timer_begins_by_idx[tidx] + i);
-    end = timespec_to_double(timer_ends_by_idx[tidx] + i);
-    double t = end - begin;
-    min = (t < min ? t : min);
+  timer_ctx* ctx = (timer_ctx*)calloc(1, sizeof(timer_ctx));
+  if (timer_shm_base) {
+    // One fetch-add per thread, ever; contexts past the region pool
+    // fall back to private storage
+    timer_shm_head* h = (timer_shm_head*)timer_shm_base;
+    uint32_t r = atomic_fetch_add(&h->claimed, 1u);
+    if (r < TIMER_SHM_REGIONS)
+      ctx->shm_region = r + 1;
   }
-  return min;
+  int want = (timer_name_cur > TIMER_INIT_SLOTS ? timer_name_cur
+                                                : TIMER_INIT_SLOTS);
+  timer_ctx_grow(ctx, want - 1);
+  timer_ctx* head = atomic_load(&timer_ctx_list);
+  do {
+    ctx->next = head;
+  } while (!atomic_compare_exchange_weak(&timer_ctx_list, &head, ctx));
+  timer_tls = ctx;
+  return ctx;
 }
 
-double timer_get_total(int tidx)
+/* Fetch the calling thread's context, creating it on first use */
+static inline timer_ctx* timer_ctx_get()
+{
+  timer_ctx* ctx = timer_tls;
+  if (!ctx)
+    ctx = timer_ctx_create();
+  return ctx;
+}
+
+int timer_set_backend(int backend)
 {
-  double begin = timespec_to_double(timer_begins_by_idx[tidx]);
-  double end = timespec_to_double(timer_ends_by_idx[tidx]);  
-  double total = 0.0;
-  for (int i = 0; i <  timer_current_by_idx[tidx]; i++) {
-    begin = timespec_to_double(timer_begins_by_idx[tidx] + i);
-    end = timespec_to_double(timer_ends_by_idx[tidx] + i);
-    total += end - begin;
+#ifdef TIMER_HAVE_TSC
+  if (backend == TIMER_BACKEND_TSC && timer_tsc_is_invariant()) {
+    timer_backend = TIMER_BACKEND_TSC;
+    return timer_backend;
   }
-  return total;
+#endif
+  timer_backend = TIMER_BACKEND_GETTIME;
+  timer_sec_per_tick = 1e-9;
+  return timer_backend;
 }
 
-int timer_print_tsv(int tidx, bool header)
+int timer_set_mode(int mode)
 {
-  char* name = timer_names[tidx];
-  double min = timer_get_min(tidx);
-  double max = timer_get_max(tidx);
-  double avg = timer_get_avg(tidx);
-  double ttl = timer_get_total(tidx);
-  if (header)
-    printf("Timer \tMin \tMax \tAvg \tTtl \n");
-  printf("%s \t%.2e \t%.2e \t%.2e \t%.2e \n", name, min, max, avg, ttl);
-  return 0;
+  timer_mode = mode;
+  return timer_mode;
+}
+
+int timer_set_spans(int nspans)
+{
+  timer_span_slots = nspans;
+  return timer_span_slots;
+}
+
+bool timer_set_compensation(bool enabled)
+{
+  timer_compensate = enabled;
+  return timer_compensate;
+}
+
+bool timer_set_hugepages(bool enabled)
+{
+  timer_use_huge = enabled;
+  return timer_use_huge;
+}
+
+int timer_set_sampling(int n)
+{
+  uint64_t cap = 1;
+  while ((int)cap < n)
+    cap *= 2;
+  timer_sample_mask = cap - 1;
+  return (int)cap;
+}
+
+/* FNV-1a hash of a timer name */
+static size_t timer_name_hash(const char* name)
+{
+  size_t h = 14695981039346656037ull;
+  for (const char* p = name; *p; p++) {
+    h ^= (unsigned char)*p;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+/* Insert idx into the hash table; caller guarantees a free slot */
+static void timer_hash_insert(int idx)
+{
+  size_t slot = timer_name_hash(timer_names[idx]) & (timer_hash_cap - 1);
+  while (timer_hash_tab[slot] != -1)
+    slot = (slot + 1) & (timer_hash_cap - 1);
+  timer_hash_tab[slot] = idx;
+}
+
+/* Grow the registry so one more timer can be created */
+static void timer_registry_reserve()
+{
+  if (timer_name_cur >= timer_name_slots) {
+    int slots = (timer_name_slots > 0 ? timer_name_slots * 2
+                                      : TIMER_INIT_SLOTS);
+    timer_names = (char(*)[MAX_NAME_SIZE])realloc(
+        timer_names, slots * sizeof(*timer_names));
+    memset(timer_names[timer_name_slots], 0,
+           (slots - timer_name_slots) * sizeof(*timer_names));
+    timer_clock_ids = (clockid_t*)realloc(timer_clock_ids,
+                                          slots * sizeof(clockid_t));
+    for (int i = timer_name_slots; i < slots; i++)
+      timer_clock_ids[i] = TIMER_CLOCK_DEFAULT;
+    timer_name_slots = slots;
+  }
+
+  // Rehash at 1/2 load so probes stay short
+  if (timer_hash_cap == 0 || (size_t)(timer_name_cur + 1) > timer_hash_cap / 2) {
+    size_t cap = (timer_hash_cap > 0 ? timer_hash_cap * 2 : 2 * TIMER_INIT_SLOTS);
+    free(timer_hash_tab);
+    timer_hash_tab = (int*)malloc(cap * sizeof(int));
+    for (size_t i = 0; i < cap; i++)
+      timer_hash_tab[i] = -1;
+    timer_hash_cap = cap;
+    for (int i = 0; i < timer_name_cur; i++) {
+      if (timer_names[i][0] != '\0')
+        timer_hash_insert(i);
+    }
+  }
+}
+
+int timer_register(const char* name)
+{
+  timer_registry_reserve();
+  int idx = timer_name_cur++;
+  strncpy(timer_names[idx], name, MAX_NAME_SIZE - 1);
+  timer_names[idx][MAX_NAME_SIZE - 1] = '\0';
+  timer_hash_insert(idx);
+  // Every worker runs the same binary, so the unsynchronized name
+  // stores in the shared header are idempotent
+  if (timer_shm_base && idx < TIMER_SHM_SLOTS)
+    memcpy(((timer_shm_head*)timer_shm_base)->names[idx],
+           timer_names[idx], MAX_NAME_SIZE);
+  return idx;
+}
+
+int timer_register_clock(const char* name, clockid_t clock)
+{
+  int idx = timer_register(name);
+  timer_clock_ids[idx] = clock;
+  // Refresh any slots created before this registration
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (idx < ctx->nslots)
+      ctx->slots[idx].clk = clock;
+  }
+  return idx;
+}
+
+int timer_lookup(const char* name)
+{
+  if (timer_hash_cap == 0)
+    return -1;
+  size_t slot = timer_name_hash(name) & (timer_hash_cap - 1);
+  while (timer_hash_tab[slot] != -1) {
+    if (strncmp(timer_names[timer_hash_tab[slot]], name, MAX_NAME_SIZE) == 0)
+      return timer_hash_tab[slot];
+    slot = (slot + 1) & (timer_hash_cap - 1);
+  }
+  return -1;
+}
+
+int timer_set_name(char* name) {
+  return timer_register(name);
+}
+
+/* Printable name for a timer: its registered name, or its index */
+static const char* timer_name(int tidx)
+{
+  static TIMER_THREAD_LOCAL char buf[MAX_NAME_SIZE];
+  if (tidx < timer_name_cur && timer_names[tidx][0] != '\0')
+    return timer_names[tidx];
+  snprintf(buf, MAX_NAME_SIZE - 1, "%d", tidx);
+  return buf;
+}
+
+/* Highest timer index in use across the registry and all contexts */
+static int timer_high_slot()
+{
+  int high = timer_name_cur;
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (ctx->nslots > high)
+      high = ctx->nslots;
+  }
+  return high;
+}
+
+/* Fold one tick delta into a running stream */
+static inline void timer_stream_fold(timer_stream* s, uint64_t t)
+{
+  s->count++;
+  s->sum += t;
+  s->min = (t < s->min ? t : s->min);
+  s->max = (t > s->max ? t : s->max);
+  s->sumsq += (unsigned __int128)t * t;
+}
+
+/* Fold n recorded begin/end pairs into a stream, one at a time */
+static void timer_fold_samples_scalar(timer_stream* s, const uint64_t* begins,
+                                      const uint64_t* ends, uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+    timer_stream_fold(s, ends[i] - begins[i]);
+}
+
+/* Selected at timer_init: AVX2 when the CPU has it, scalar otherwise */
+static void (*timer_fold_samples)(timer_stream*, const uint64_t*,
+                                  const uint64_t*, uint64_t) =
+    timer_fold_samples_scalar;
+
+#ifdef __x86_64__
+/* AVX2 kernel: subtract, min/max, and sum four 64-bit deltas per
+   iteration. Deltas fit comfortably in 63 bits so signed compares are
+   safe. The squares use four scalar 64x64->128 multiply-accumulates
+   per iteration — a single MUL each — keeping the sum of squares
+   exact where a vectorized double would round. */
+__attribute__((target("avx2")))
+static void timer_fold_samples_avx2(timer_stream* s, const uint64_t* begins,
+                                    const uint64_t* ends, uint64_t n)
+{
+  __m256i vmin = _mm256_set1_epi64x(INT64_MAX);
+  __m256i vmax = _mm256_setzero_si256();
+  __m256i vsum = _mm256_setzero_si256();
+  unsigned __int128 sumsq = 0;
+
+  uint64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i b = _mm256_loadu_si256((const __m256i*)(begins + i));
+    __m256i e = _mm256_loadu_si256((const __m256i*)(ends + i));
+    __m256i t = _mm256_sub_epi64(e, b);
+    __m256i lt = _mm256_cmpgt_epi64(vmin, t);
+    vmin = _mm256_blendv_epi8(vmin, t, lt);
+    __m256i gt = _mm256_cmpgt_epi64(t, vmax);
+    vmax = _mm256_blendv_epi8(vmax, t, gt);
+    vsum = _mm256_add_epi64(vsum, t);
+    uint64_t lane_t[4];
+    _mm256_storeu_si256((__m256i*)lane_t, t);
+    for (int l = 0; l < 4; l++)
+      sumsq += (unsigned __int128)lane_t[l] * lane_t[l];
+  }
+
+  // Merge the lanes only when the vector loop ran, so an empty fold
+  // cannot leak the lane initializers into the stream's extrema
+  if (i) {
+    uint64_t lane_min[4], lane_max[4], lane_sum[4];
+    _mm256_storeu_si256((__m256i*)lane_min, vmin);
+    _mm256_storeu_si256((__m256i*)lane_max, vmax);
+    _mm256_storeu_si256((__m256i*)lane_sum, vsum);
+    for (int l = 0; l < 4; l++) {
+      s->min = (lane_min[l] < s->min ? lane_min[l] : s->min);
+      s->max = (lane_max[l] > s->max ? lane_max[l] : s->max);
+      s->sum += lane_sum[l];
+    }
+    s->sumsq += sumsq;
+  }
+  s->count += i;
+
+  // Remaining tail samples
+  timer_fold_samples_scalar(s, begins + i, ends + i, n - i);
+}
+#endif
+
+int timer_init(size_t iterations)
+{
+  timer_iterations = iterations;
+  if (timer_mode == TIMER_MODE_RING) {
+    // Round the ring capacity up to a power of two for masked writes
+    uint64_t cap = 1;
+    while (cap < iterations)
+      cap *= 2;
+    timer_iterations = cap;
+    timer_ring_mask = cap - 1;
+  }
+
+#ifdef TIMER_HAVE_TSC
+  // Calibrate the TSC against CLOCK_MONOTONIC
+  if (timer_backend == TIMER_BACKEND_TSC)
+    timer_sec_per_tick = timer_tsc_calibrate();
+#endif
+
+#ifdef __x86_64__
+  // Pick the widest statistics kernel this CPU supports
+  if (__builtin_cpu_supports("avx2"))
+    timer_fold_samples = timer_fold_samples_avx2;
+#endif
+
+  // Create the main thread's context
+  timer_ctx_create();
+
+  // Thread the span pool onto its freelist
+  timer_span_pool = (timer_span*)calloc(timer_span_slots, sizeof(timer_span));
+  for (int i = 0; i < timer_span_slots; i++)
+    timer_span_pool[i].next = (i + 1 < timer_span_slots ? (uint32_t)(i + 1)
+                                                        : TIMER_SPAN_NONE);
+  atomic_store(&timer_span_free, 0);
+
+  // Use timer 0 to measure the overhead of the active backend
+  int clk = timer_register("CLCK");
+  timer_overhead_ticks = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    timer_begin(clk);
+    timer_raw_now();
+    timer_end(clk);
+  }
+  // Take the median of the calibration distribution as the overhead
+  // estimate; a mean would be dragged upward by the few iterations
+  // that caught a preemption or SMI
+  timer_overhead_ticks =
+      (uint64_t)(timer_get_percentile(clk, 50) / timer_sec_per_tick + 0.5);
+  return 0;
+}
+
+int timer_destroy() {
+  if (timer_flush_running)
+    timer_flush_stop();
+  if (timer_watch_running)
+    timer_watchdog_stop();
+
+  // Print the aggregated timers and deallocate every context
+  timer_print_tsv(0, true);
+  int high = timer_high_slot();
+  for (int i = 1; i < high; i++) {
+    if (0 < timer_get_count(i)) {
+      timer_print_tsv(i, false);
+    }
+  }
+
+  if (timer_shm_base)
+    timer_shm_publish();
+
+  timer_ctx* ctx = atomic_exchange(&timer_ctx_list, NULL);
+  while (ctx) {
+    timer_ctx* next = ctx->next;
+    timer_arena* a = ctx->arena;
+    while (a) {
+      timer_arena* anext = a->next;
+      munmap(a->base, a->size);
+      free(a);
+      a = anext;
+    }
+    free(ctx->slots);
+    free(ctx);
+    ctx = next;
+  }
+  timer_tls = NULL;
+
+  free(timer_names);
+  timer_names = NULL;
+  free(timer_clock_ids);
+  timer_clock_ids = NULL;
+  timer_name_slots = 0;
+  timer_name_cur = 0;
+  free(timer_hash_tab);
+  timer_hash_tab = NULL;
+  timer_hash_cap = 0;
+  free(timer_span_pool);
+  timer_span_pool = NULL;
+  atomic_store(&timer_span_free, TIMER_SPAN_NONE);
+  free(timer_stats_cache);
+  free(timer_stats_count);
+  free(timer_stats_valid);
+  timer_stats_cache = NULL;
+  timer_stats_count = NULL;
+  timer_stats_valid = NULL;
+  timer_stats_slots = 0;
+  if (timer_shm_base) {
+    munmap(timer_shm_base, timer_shm_size);
+    timer_shm_base = NULL;
+    timer_shm_size = 0;
+    close(timer_shm_fd);
+    timer_shm_fd = -1;
+  }
+  return 0;
+}
+
+int timer_init_shm(const char* name, size_t iterations)
+{
+  uint64_t iters = iterations;
+  if (timer_mode == TIMER_MODE_RING) {
+    // Match the rounding timer_init applies to the ring capacity
+    uint64_t cap = 1;
+    while (cap < iters)
+      cap *= 2;
+    iters = cap;
+  }
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+  if (fd < 0)
+    return -1;
+  size_t size = timer_shm_segment_bytes(iters, (uint32_t)timer_mode);
+  if (ftruncate(fd, (off_t)size) != 0) {
+    close(fd);
+    return -1;
+  }
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+
+  // Every worker writes identical header values over the zero-filled
+  // segment, so the unsynchronized initialization is idempotent
+  timer_shm_head* h = (timer_shm_head*)base;
+  h->mode = (uint32_t)timer_mode;
+  h->iterations = iters;
+  timer_shm_base = base;
+  timer_shm_size = size;
+  timer_shm_fd = fd;
+
+  int rc = timer_init(iterations);
+  h->sec_per_tick = timer_sec_per_tick;
+  h->magic = TIMER_SHM_MAGIC;
+  return rc;
+}
+
+int timer_shm_publish()
+{
+  if (timer_shm_base == NULL)
+    return -1;
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    for (int i = 0; i < ctx->nslots && i < TIMER_SHM_SLOTS; i++) {
+      timer_slot* slot = &ctx->slots[i];
+      if (slot->shm == NULL)
+        continue;
+      slot->shm->stream = slot->stream;
+      slot->shm->count = (timer_mode == TIMER_MODE_STREAM
+                              ? slot->stream.count
+                              : slot->current);
+    }
+  }
+  return 0;
+}
+
+int timer_shm_attach(const char* name)
+{
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return -1;
+  }
+  void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+  if (((timer_shm_head*)base)->magic != TIMER_SHM_MAGIC) {
+    munmap(base, (size_t)st.st_size);
+    return -1;
+  }
+  timer_shm_agg = base;
+  timer_shm_agg_size = (size_t)st.st_size;
+  return 0;
+}
+
+timer_stream timer_shm_stats(int tidx)
+{
+  timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+  if (timer_shm_agg == NULL)
+    return agg;
+  timer_shm_head* h = (timer_shm_head*)timer_shm_agg;
+  uint32_t regions = atomic_load(&h->claimed);
+  if (regions > TIMER_SHM_REGIONS)
+    regions = TIMER_SHM_REGIONS;
+  for (uint32_t r = 0; r < regions; r++) {
+    timer_shm_slot* ss = timer_shm_slot_at(timer_shm_agg, r, tidx);
+    if (h->mode == TIMER_MODE_RECORD) {
+      // Reduce the raw samples straight out of the mapping
+      uint64_t n = (ss->count < h->iterations ? ss->count : h->iterations);
+      uint64_t* b = timer_shm_slot_begins(ss);
+      timer_fold_samples(&agg, b, b + timer_shm_arr_words(h->iterations), n);
+    } else {
+      // Streaming and ring regions publish their running stats
+      agg.count += ss->stream.count;
+      agg.sum += ss->stream.sum;
+      agg.min = (ss->stream.min < agg.min ? ss->stream.min : agg.min);
+      agg.max = (ss->stream.max > agg.max ? ss->stream.max : agg.max);
+      agg.sumsq += ss->stream.sumsq;
+    }
+  }
+  return agg;
+}
+
+int timer_shm_print_tsv()
+{
+  if (timer_shm_agg == NULL)
+    return -1;
+  timer_shm_head* h = (timer_shm_head*)timer_shm_agg;
+  double sec = h->sec_per_tick;
+  printf("Timer \tCount \tMin \tMax \tAvg \tTtl \n");
+  for (int t = 0; t < TIMER_SHM_SLOTS; t++) {
+    timer_stream agg = timer_shm_stats(t);
+    if (agg.count == 0)
+      continue;
+    char num[16];
+    const char* name = h->names[t];
+    if (name[0] == '\0') {
+      snprintf(num, sizeof(num), "%d", t);
+      name = num;
+    }
+    printf("%s \t%llu \t%.2e \t%.2e \t%.2e \t%.2e \n", name,
+           (unsigned long long)agg.count, (double)agg.min * sec,
+           (double)agg.max * sec,
+           (double)agg.sum * sec / (double)agg.count,
+           (double)agg.sum * sec);
+  }
+  return 0;
+}
+
+int timer_shm_detach()
+{
+  if (timer_shm_agg == NULL)
+    return -1;
+  munmap(timer_shm_agg, timer_shm_agg_size);
+  timer_shm_agg = NULL;
+  timer_shm_agg_size = 0;
+  return 0;
+}
+
+/* Map a tick delta to its log-linear histogram bucket */
+static inline int timer_hist_idx(uint64_t t)
+{
+  if (t < TIMER_HIST_SUB)
+    return (int)t;
+  int shift = (63 - __builtin_clzll(t)) - TIMER_HIST_SUB_BITS;
+  return ((shift + 1) << TIMER_HIST_SUB_BITS) |
+         ((t >> shift) & (TIMER_HIST_SUB - 1));
+}
+
+/* Midpoint tick value represented by a histogram bucket */
+static inline uint64_t timer_hist_value(int idx)
+{
+  if (idx < (int)TIMER_HIST_SUB)
+    return (uint64_t)idx;
+  int shift = (idx >> TIMER_HIST_SUB_BITS) - 1;
+  uint64_t base = (uint64_t)(TIMER_HIST_SUB + (idx & (TIMER_HIST_SUB - 1)));
+  return (base << shift) + (1ull << shift) / 2;
+}
+
+/* Number of raw samples a slot currently holds (ring mode retains
+   only the newest timer_iterations of them) */
+static uint64_t timer_slot_retained(const timer_slot* slot)
+{
+  if (timer_mode == TIMER_MODE_STREAM)
+    return 0;
+  if (timer_mode == TIMER_MODE_RING && slot->current > timer_ring_mask + 1)
+    return timer_ring_mask + 1;
+  return slot->current;
+}
+
+
+int timer_begin(int tidx)
+{
+  timer_ctx* ctx = timer_ctx_get();
+  if (tidx >= ctx->nslots)
+    timer_ctx_grow(ctx, tidx);
+  timer_slot* slot = &ctx->slots[tidx];
+  // Skip all but every Nth invocation; the begin-side increment is
+  // the only bookkeeping the skip path pays
+  if (timer_sample_mask && (slot->calls++ & timer_sample_mask))
+    return 0;
+  if (ctx->depth < TIMER_STACK_DEPTH)
+    ctx->stack[ctx->depth++] = tidx;
+  if (timer_mode == TIMER_MODE_STREAM) {
+    slot->pending = timer_slot_now(slot);
+    return 0;
+  }
+  if (timer_mode == TIMER_MODE_RING) {
+    slot->begins[slot->current & timer_ring_mask] = timer_slot_now(slot);
+    return 0;
+  }
+  slot->begins[slot->current] = timer_slot_now(slot);
+  return 0;
+}
+
+int timer_end(int tidx)
+{
+  timer_ctx* ctx = timer_ctx_get();
+  if (tidx >= ctx->nslots)
+    timer_ctx_grow(ctx, tidx);
+  timer_slot* slot = &ctx->slots[tidx];
+  // Mirror the begin-side sampling decision for the same invocation
+  if (timer_sample_mask && ((slot->calls - 1) & timer_sample_mask))
+    return 0;
+  uint64_t end = timer_slot_now(slot);
+  uint64_t t;
+  if (timer_mode == TIMER_MODE_STREAM) {
+    t = end - slot->pending;
+    timer_stream_fold(&slot->stream, t);
+    if (slot->shm) {
+      slot->shm->stream = slot->stream;
+      slot->shm->count = slot->stream.count;
+    }
+  } else if (timer_mode == TIMER_MODE_RING) {
+    uint64_t idx = slot->current & timer_ring_mask;
+    slot->ends[idx] = end;
+    t = end - slot->begins[idx];
+    timer_stream_fold(&slot->stream, t);
+    slot->current++;
+    if (slot->shm) {
+      slot->shm->stream = slot->stream;
+      slot->shm->count = slot->current;
+    }
+  } else {
+    slot->ends[slot->current] = end;
+    t = end - slot->begins[slot->current];
+    slot->current++;
+    // Publish the cursor so a live aggregator sees this sample
+    if (slot->shm)
+      slot->shm->count = slot->current;
+  }
+  slot->hist[timer_hist_idx(t)]++;
+
+  // Pop the nesting stack and charge this interval to the parent
+  if (ctx->depth > 0 && ctx->stack[ctx->depth - 1] == tidx) {
+    ctx->depth--;
+    if (ctx->depth > 0)
+      ctx->slots[ctx->stack[ctx->depth - 1]].child += t;
+  }
+  return 0;
+}
+
+size_t timer_record_batch(int tidx, const uint64_t* begins,
+                          const uint64_t* ends, size_t n)
+{
+  timer_ctx* ctx = timer_ctx_get();
+  if (tidx >= ctx->nslots)
+    timer_ctx_grow(ctx, tidx);
+  timer_slot* slot = &ctx->slots[tidx];
+
+  if (timer_mode == TIMER_MODE_RECORD) {
+    // One bounds check, two memcpys
+    size_t room = (slot->current < timer_iterations
+                       ? timer_iterations - slot->current
+                       : 0);
+    size_t take = (n < room ? n : room);
+    memcpy(slot->begins + slot->current, begins, take * sizeof(uint64_t));
+    memcpy(slot->ends + slot->current, ends, take * sizeof(uint64_t));
+    for (size_t i = 0; i < take; i++)
+      slot->hist[timer_hist_idx(ends[i] - begins[i])]++;
+    slot->current += take;
+    if (slot->shm)
+      slot->shm->count = slot->current;
+    return take;
+  }
+
+  if (timer_mode == TIMER_MODE_RING) {
+    for (size_t i = 0; i < n; i++) {
+      uint64_t idx = (slot->current + i) & timer_ring_mask;
+      slot->begins[idx] = begins[i];
+      slot->ends[idx] = ends[i];
+    }
+    slot->current += n;
+  }
+  timer_fold_samples(&slot->stream, begins, ends, n);
+  for (size_t i = 0; i < n; i++)
+    slot->hist[timer_hist_idx(ends[i] - begins[i])]++;
+  if (slot->shm) {
+    slot->shm->stream = slot->stream;
+    slot->shm->count = (timer_mode == TIMER_MODE_RING ? slot->current
+                                                      : slot->stream.count);
+  }
+  return n;
+}
+
+int timer_span_begin(int tidx)
+{
+  uint64_t head = atomic_load(&timer_span_free);
+  uint32_t idx;
+  uint64_t next;
+  do {
+    idx = (uint32_t)head;
+    if (idx == TIMER_SPAN_NONE)
+      return -1;
+    next = (((head >> 32) + 1) << 32) | timer_span_pool[idx].next;
+  } while (!atomic_compare_exchange_weak(&timer_span_free, &head, next));
+  timer_span_pool[idx].tidx = tidx;
+  timer_span_pool[idx].begin = timer_raw_now();
+  return (int)idx;
+}
+
+int timer_span_end(int handle)
+{
+  timer_span* sp = &timer_span_pool[handle];
+  uint64_t end = timer_raw_now();
+  uint64_t begin = sp->begin;
+  int tidx = sp->tidx;
+
+  // Record into the completing thread's context, mirroring timer_end
+  timer_ctx* ctx = timer_ctx_get();
+  if (tidx >= ctx->nslots)
+    timer_ctx_grow(ctx, tidx);
+  timer_slot* slot = &ctx->slots[tidx];
+  uint64_t t = end - begin;
+  if (timer_mode == TIMER_MODE_STREAM) {
+    timer_stream_fold(&slot->stream, t);
+  } else if (timer_mode == TIMER_MODE_RING) {
+    uint64_t idx = slot->current & timer_ring_mask;
+    slot->begins[idx] = begin;
+    slot->ends[idx] = end;
+    timer_stream_fold(&slot->stream, t);
+    slot->current++;
+  } else {
+    slot->begins[slot->current] = begin;
+    slot->ends[slot->current] = end;
+    slot->current++;
+  }
+  slot->hist[timer_hist_idx(t)]++;
+
+  // Push the slot back with a single tagged compare-and-swap
+  uint64_t head = atomic_load(&timer_span_free);
+  uint64_t next;
+  do {
+    sp->next = (uint32_t)head;
+    next = (((head >> 32) + 1) << 32) | (uint32_t)handle;
+  } while (!atomic_compare_exchange_weak(&timer_span_free, &head, next));
+  return 0;
+}
+
+/* Aggregate one timer's statistics across every context. In record
+   mode this walks the sample arrays; in streaming mode it merges the
+   per-thread running streams. */
+static timer_stream timer_stream_gather(int tidx)
+{
+  timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (tidx >= ctx->nslots)
+      continue;
+    timer_slot* slot = &ctx->slots[tidx];
+    timer_stream* s = &slot->stream;
+    agg.count += s->count;
+    agg.sum += s->sum;
+    agg.min = (s->min < agg.min ? s->min : agg.min);
+    agg.max = (s->max > agg.max ? s->max : agg.max);
+    agg.sumsq += s->sumsq;
+    if (timer_mode == TIMER_MODE_RECORD) {
+      // Live samples not yet folded by a background flush
+      timer_fold_samples(&agg, slot->begins, slot->ends, slot->current);
+    }
+  }
+  return agg;
+}
+
+size_t timer_get_count(int tidx)
+{
+  size_t count = 0;
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (tidx >= ctx->nslots)
+      continue;
+    count += ctx->slots[tidx].stream.count;
+    if (timer_mode == TIMER_MODE_RECORD)
+      count += ctx->slots[tidx].current;
+  }
+  return count;
+}
+
+/* Return the cached fused-pass statistics for a timer, recomputing
+   only when the sample count has changed since the last gather. Every
+   getter shares this, so printing all summary columns costs a single
+   pass over the samples instead of one pass per getter. */
+static timer_stream* timer_stats_get(int tidx)
+{
+  if (tidx >= timer_stats_slots) {
+    int slots = (timer_stats_slots > 0 ? timer_stats_slots : TIMER_INIT_SLOTS);
+    while (slots <= tidx)
+      slots *= 2;
+    timer_stats_cache = (timer_stream*)realloc(timer_stats_cache,
+                                               slots * sizeof(timer_stream));
+    timer_stats_count = (size_t*)realloc(timer_stats_count,
+                                         slots * sizeof(size_t));
+    timer_stats_valid = (bool*)realloc(timer_stats_valid,
+                                       slots * sizeof(bool));
+    for (int i = timer_stats_slots; i < slots; i++)
+      timer_stats_valid[i] = false;
+    timer_stats_slots = slots;
+  }
+  size_t count = timer_get_count(tidx);
+  if (!timer_stats_valid[tidx] || timer_stats_count[tidx] != count) {
+    timer_stats_cache[tidx] = timer_stream_gather(tidx);
+    timer_stats_count[tidx] = count;
+    timer_stats_valid[tidx] = true;
+  }
+  return &timer_stats_cache[tidx];
+}
+
+double timer_get_avg(int tidx)
+{
+  timer_stream* s = timer_stats_get(tidx);
+  return timer_comp_to_sec((double)s->sum / (double)s->count,
+                           timer_tick_rate(tidx));
+}
+
+double timer_get_max(int tidx)
+{
+  timer_stream* s = timer_stats_get(tidx);
+  return timer_comp_to_sec((double)s->max, timer_tick_rate(tidx));
+}
+
+double timer_get_min(int tidx)
+{
+  timer_stream* s = timer_stats_get(tidx);
+  return (s->min == UINT64_MAX
+              ? 0.0
+              : timer_comp_to_sec((double)s->min, timer_tick_rate(tidx)));
+}
+
+double timer_get_total(int tidx)
+{
+  // The per-sample overhead accumulates across the whole total, and
+  // a sampled timer's total is scaled back up by the interval
+  timer_stream* s = timer_stats_get(tidx);
+  if (s->count == 0)
+    return 0.0;
+  return timer_comp_to_sec((double)s->sum / (double)s->count,
+                           timer_tick_rate(tidx))
+         * (double)s->count * (double)(timer_sample_mask + 1);
+}
+
+double timer_get_stddev(int tidx)
+{
+  timer_stream* s = timer_stats_get(tidx);
+  if (s->count == 0)
+    return 0.0;
+  // Convert to double only here, at the final reporting step
+  double mean = (double)s->sum / (double)s->count;
+  double var = ((double)s->sumsq / (double)s->count) - (mean * mean);
+  if (var < 0.0)
+    var = 0.0;
+  // A constant overhead shift leaves the deviation unchanged
+  return sqrt(var) * timer_tick_rate(tidx);
+}
+
+double timer_get_self(int tidx)
+{
+  uint64_t child = 0;
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (tidx < ctx->nslots)
+      child += ctx->slots[tidx].child;
+  }
+  return timer_get_total(tidx)
+         - timer_raw_to_sec(child) * (double)(timer_sample_mask + 1);
+}
+
+double timer_get_percentile(int tidx, double p)
+{
+  // Merge the per-thread histograms for this timer
+  uint64_t total = 0;
+  static uint64_t merged[TIMER_HIST_BUCKETS];
+  memset(merged, 0, sizeof(merged));
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (tidx >= ctx->nslots)
+      continue;
+    for (int i = 0; i < (int)TIMER_HIST_BUCKETS; i++) {
+      merged[i] += ctx->slots[tidx].hist[i];
+      total += ctx->slots[tidx].hist[i];
+    }
+  }
+  if (total == 0)
+    return 0.0;
+
+  // Walk buckets until the cumulative count covers the percentile
+  uint64_t target = (uint64_t)((p / 100.0) * (double)total + 0.5);
+  if (target > total)
+    target = total;
+  uint64_t seen = 0;
+  for (int i = 0; i < (int)TIMER_HIST_BUCKETS; i++) {
+    seen += merged[i];
+    if (seen >= target)
+      return timer_comp_to_sec((double)timer_hist_value(i),
+                               timer_tick_rate(tidx));
+  }
+  return timer_get_max(tidx);
+}
+
+/* Emit one timer's summary row; shared by the public stdout printer
+   and the watchdog sink */
+static int timer_print_tsv_file(FILE* f, int tidx, bool header)
+{
+  const char* name = timer_name(tidx);
+  double min = timer_get_min(tidx);
+  double max = timer_get_max(tidx);
+  double avg = timer_get_avg(tidx);
+  double ttl = timer_get_total(tidx);
+  double self = timer_get_self(tidx);
+  double p50 = timer_get_percentile(tidx, 50);
+  double p90 = timer_get_percentile(tidx, 90);
+  double p99 = timer_get_percentile(tidx, 99);
+  double p999 = timer_get_percentile(tidx, 99.9);
+  if (header)
+    fprintf(f,
+            "Timer \tMin \tMax \tAvg \tTtl \tSelf \tP50 \tP90 \tP99 \tP999 \n");
+  fprintf(f,
+          "%s \t%.2e \t%.2e \t%.2e \t%.2e \t%.2e \t%.2e \t%.2e \t%.2e \t%.2e \n",
+          name, min, max, avg, ttl, self, p50, p90, p99, p999);
+  return 0;
+}
+
+int timer_print_tsv(int tidx, bool header)
+{
+  return timer_print_tsv_file(stdout, tidx, header);
+}
+
+/* Label of the phase opened by timer_epoch_begin */
+static const char* timer_epoch_label = NULL;
+
+int timer_epoch_begin(const char* label)
+{
+  timer_epoch_label = label;
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    for (int i = 0; i < ctx->nslots; i++) {
+      ctx->slots[i].mark = ctx->slots[i].current;
+      ctx->slots[i].mark_stream = ctx->slots[i].stream;
+    }
+  }
+  return 0;
+}
+
+/* Gather statistics over the samples recorded since the epoch mark:
+   the running-stream delta covers everything folded away since the
+   snapshot (flushed epochs, spans, streaming mode), and the window
+   past the saved cursor covers the live arrays. */
+static timer_stream timer_epoch_gather(int tidx)
+{
+  timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    if (tidx >= ctx->nslots)
+      continue;
+    timer_slot* slot = &ctx->slots[tidx];
+    agg.count += slot->stream.count - slot->mark_stream.count;
+    agg.sum += slot->stream.sum - slot->mark_stream.sum;
+    agg.sumsq += slot->stream.sumsq - slot->mark_stream.sumsq;
+    if (slot->begins == NULL || slot->current <= slot->mark)
+      continue;
+    uint64_t first = slot->mark;
+    uint64_t n = slot->current - first;
+    if (timer_mode == TIMER_MODE_RING) {
+      if (n > timer_ring_mask + 1) {
+        n = timer_ring_mask + 1;
+        first = slot->current - n;
+      }
+      for (uint64_t j = 0; j < n; j++) {
+        uint64_t idx = (first + j) & timer_ring_mask;
+        timer_stream_fold(&agg, slot->ends[idx] - slot->begins[idx]);
+      }
+    } else {
+      timer_fold_samples(&agg, slot->begins + first, slot->ends + first, n);
+    }
+  }
+  return agg;
+}
+
+int timer_epoch_end()
+{
+  if (timer_epoch_label == NULL)
+    return -1;
+  printf("Epoch \tTimer \tCount \tMin \tMax \tAvg \tTtl \n");
+  int high = timer_high_slot();
+  for (int i = 1; i < high; i++) {
+    timer_stream agg = timer_epoch_gather(i);
+    if (agg.count == 0)
+      continue;
+    double rate = timer_tick_rate(i);
+    double avg = timer_comp_to_sec((double)agg.sum / (double)agg.count, rate);
+    printf("%s \t%s \t%llu \t%.2e \t%.2e \t%.2e \t%.2e \n",
+           timer_epoch_label, timer_name(i), (unsigned long long)agg.count,
+           (agg.min == UINT64_MAX
+                ? 0.0
+                : timer_comp_to_sec((double)agg.min, rate)),
+           timer_comp_to_sec((double)agg.max, rate), avg,
+           avg * (double)agg.count);
+  }
+  timer_epoch_label = NULL;
+  return 0;
+}
+
+/* Stream one epoch: swap every slot's buffers, write the retired
+   samples to the sink, and reset the per-epoch counts. The swap is
+   plain stores — a probe racing the swap can land its sample on
+   either side of the epoch boundary, which is harmless for summary
+   statistics. */
+static void timer_flush_pass()
+{
+  for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+    for (int i = 0; i < ctx->nslots; i++) {
+      timer_slot* slot = &ctx->slots[i];
+      uint64_t n = slot->current;
+      if (n == 0 || slot->begins == NULL || slot->begins2 == NULL)
+        continue;
+
+      // Retire the active buffers and hand the shadows to the probes
+      uint64_t* b = slot->begins;
+      uint64_t* e = slot->ends;
+      slot->begins = slot->begins2;
+      slot->ends = slot->ends2;
+      slot->current = 0;
+      slot->begins2 = b;
+      slot->ends2 = e;
+
+      uint64_t retained = n;
+      uint64_t first = 0;
+      if (timer_mode == TIMER_MODE_RING && n > timer_ring_mask + 1) {
+        retained = timer_ring_mask + 1;
+        first = n - retained;
+      }
+
+      timer_stream agg = {0, 0, UINT64_MAX, 0, 0};
+      if (timer_mode == TIMER_MODE_RING) {
+        for (uint64_t j = 0; j < retained; j++) {
+          uint64_t idx = (first + j) & timer_ring_mask;
+          timer_stream_fold(&agg, e[idx] - b[idx]);
+        }
+      } else {
+        timer_fold_samples(&agg, b, e, retained);
+      }
+
+      if (timer_flush_format == TIMER_FLUSH_BINARY) {
+        uint64_t rec[3] = {timer_flush_epoch, (uint64_t)i, retained};
+        fwrite(rec, sizeof(uint64_t), 3, timer_flush_file);
+        for (uint64_t j = 0; j < retained; j++) {
+          uint64_t idx = (timer_mode == TIMER_MODE_RING
+                              ? (first + j) & timer_ring_mask
+                              : first + j);
+          uint64_t t = e[idx] - b[idx];
+          fwrite(&t, sizeof(uint64_t), 1, timer_flush_file);
+        }
+      } else {
+        fprintf(timer_flush_file,
+                "%llu \t%s \t%llu \t%.2e \t%.2e \t%.2e \t%.2e \n",
+                (unsigned long long)timer_flush_epoch, timer_name(i),
+                (unsigned long long)agg.count, timer_raw_to_sec(agg.min),
+                timer_raw_to_sec(agg.max),
+                (double)agg.sum * timer_sec_per_tick / (double)agg.count,
+                (double)agg.sum * timer_sec_per_tick);
+      }
+
+      // Keep full-run summaries exact after the samples leave memory
+      if (timer_mode == TIMER_MODE_RECORD) {
+        slot->stream.count += agg.count;
+        slot->stream.sum += agg.sum;
+        slot->stream.min =
+            (agg.min < slot->stream.min ? agg.min : slot->stream.min);
+        slot->stream.max =
+            (agg.max > slot->stream.max ? agg.max : slot->stream.max);
+        slot->stream.sumsq += agg.sumsq;
+      }
+    }
+  }
+  fflush(timer_flush_file);
+  timer_flush_epoch++;
+}
+
+/* Flusher main loop: drop to idle priority, then flush every interval */
+static void* timer_flush_main(void* arg)
+{
+#ifdef SCHED_IDLE
+  struct sched_param param = {0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#else
+  setpriority(PRIO_PROCESS, 0, 19); /* per-thread on Linux */
+#endif
+
+  struct timespec tick = {0, 10000000}; /* poll the stop flag at 10ms */
+  double waited = 0.0;
+  while (timer_flush_running) {
+    nanosleep(&tick, NULL);
+    waited += 0.01;
+    if (waited >= timer_flush_interval) {
+      timer_flush_pass();
+      waited = 0.0;
+    }
+  }
+  return NULL;
+}
+
+int timer_flush_start(const char* path, int format, double interval_sec)
+{
+  if (timer_flush_running)
+    return -1;
+  timer_flush_file = fopen(path, "w");
+  if (timer_flush_file == NULL)
+    return -1;
+  timer_flush_format = format;
+  timer_flush_interval = interval_sec;
+  timer_flush_epoch = 0;
+  if (format == TIMER_FLUSH_TSV)
+    fprintf(timer_flush_file, "Epoch \tTimer \tCount \tMin \tMax \tAvg \tTtl \n");
+  timer_flush_running = 1;
+  if (pthread_create(&timer_flush_thread, NULL, timer_flush_main, NULL) != 0) {
+    timer_flush_running = 0;
+    fclose(timer_flush_file);
+    timer_flush_file = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+int timer_flush_stop()
+{
+  if (!timer_flush_running)
+    return -1;
+  timer_flush_running = 0;
+  pthread_join(timer_flush_thread, NULL);
+  timer_flush_pass();
+  fclose(timer_flush_file);
+  timer_flush_file = NULL;
+  return 0;
+}
+
+/* Write a full report to the watchdog sink, one row per active timer */
+static void timer_watch_emit()
+{
+  timer_print_tsv_file(timer_watch_file, 0, true);
+  int high = timer_high_slot();
+  for (int i = 1; i < high; i++) {
+    if (0 < timer_get_count(i))
+      timer_print_tsv_file(timer_watch_file, i, false);
+  }
+  fflush(timer_watch_file);
+}
+
+/* Async-signal-safe by construction: one flag store, nothing else */
+static void timer_watch_signal(int sig)
+{
+  (void)sig;
+  timer_watch_fire = 1;
+}
+
+static void* timer_watch_main(void* arg)
+{
+  (void)arg;
+#ifdef SCHED_IDLE
+  struct sched_param param = {0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#else
+  setpriority(PRIO_PROCESS, 0, 19); /* per-thread on Linux */
+#endif
+
+  struct timespec tick = {0, 10000000}; /* poll the fire flag at 10ms */
+  while (timer_watch_running) {
+    nanosleep(&tick, NULL);
+    if (timer_watch_fire) {
+      timer_watch_fire = 0;
+      timer_watch_emit();
+    }
+  }
+  return NULL;
+}
+
+int timer_watchdog_start(const char* path)
+{
+  if (timer_watch_running)
+    return -1;
+  timer_watch_file = (path == NULL || strcmp(path, "-") == 0)
+                         ? stderr
+                         : fopen(path, "a");
+  if (timer_watch_file == NULL)
+    return -1;
+  timer_watch_fire = 0;
+  timer_watch_running = 1;
+  signal(SIGUSR2, timer_watch_signal);
+  if (pthread_create(&timer_watch_thread, NULL, timer_watch_main, NULL) != 0) {
+    signal(SIGUSR2, SIG_DFL);
+    timer_watch_running = 0;
+    if (timer_watch_file != stderr)
+      fclose(timer_watch_file);
+    timer_watch_file = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+int timer_watchdog_stop()
+{
+  if (!timer_watch_running)
+    return -1;
+  timer_watch_running = 0;
+  pthread_join(timer_watch_thread, NULL);
+  signal(SIGUSR2, SIG_DFL);
+  // Honor a request that raced the shutdown
+  if (timer_watch_fire) {
+    timer_watch_fire = 0;
+    timer_watch_emit();
+  }
+  if (timer_watch_file != stderr)
+    fclose(timer_watch_file);
+  timer_watch_file = NULL;
+  return 0;
+}
+
+/* Append a string to the report buffer */
+static char* timer_fmt_str(char* p, const char* str)
+{
+  while (*str)
+    *p++ = *str++;
+  return p;
+}
+
+/* Format v exactly like printf "%.2e". Two significant digits need
+   none of the general shortest-round-trip machinery: normalize the
+   mantissa into [1, 10), round to three digits, and emit — a handful
+   of multiplies against printf's whole format interpreter. */
+static char* timer_fmt_e2(char* p, double v)
+{
+  if (v < 0.0) {
+    *p++ = '-';
+    v = -v;
+  }
+  if (v == 0.0)
+    return timer_fmt_str(p, "0.00e+00");
+  int e = 0;
+  while (v >= 10.0) {
+    v /= 10.0;
+    e++;
+  }
+  while (v < 1.0) {
+    v *= 10.0;
+    e--;
+  }
+  int m = (int)(v * 100.0 + 0.5); /* 100..1000 after rounding */
+  if (m >= 1000) {
+    m /= 10;
+    e++;
+  }
+  *p++ = (char)('0' + m / 100);
+  *p++ = '.';
+  *p++ = (char)('0' + (m / 10) % 10);
+  *p++ = (char)('0' + m % 10);
+  *p++ = 'e';
+  *p++ = (e < 0 ? '-' : '+');
+  int ae = (e < 0 ? -e : e);
+  if (ae >= 100)
+    *p++ = (char)('0' + ae / 100);
+  *p++ = (char)('0' + (ae / 10) % 10);
+  *p++ = (char)('0' + ae % 10);
+  return p;
+}
+
+int timer_write_report(const char* path, int format)
+{
+  static const char* cols[] = {"Min", "Max", "Avg", "Ttl",  "Self",
+                               "P50", "P90", "P99", "P999"};
+  static const char* keys[] = {"min", "max", "avg", "total", "self",
+                               "p50", "p90", "p99", "p999"};
+  int high = timer_high_slot();
+
+  // One buffer for the whole report; rows are well under 512 bytes
+  size_t cap = 256 + (size_t)high * 512;
+  char* buf = (char*)malloc(cap);
+  char* p = buf;
+  char sep = (format == TIMER_REPORT_CSV ? ',' : '\t');
+
+  if (format != TIMER_REPORT_JSONL) {
+    p = timer_fmt_str(p, "Timer");
+    for (int c = 0; c < 9; c++) {
+      *p++ = sep;
+      p = timer_fmt_str(p, cols[c]);
+    }
+    *p++ = '\n';
+  }
+  for (int i = 0; i < high; i++) {
+    if (i != 0 && timer_get_count(i) == 0)
+      continue;
+    double vals[9] = {timer_get_min(i),
+                      timer_get_max(i),
+                      timer_get_avg(i),
+                      timer_get_total(i),
+                      timer_get_self(i),
+                      timer_get_percentile(i, 50),
+                      timer_get_percentile(i, 90),
+                      timer_get_percentile(i, 99),
+                      timer_get_percentile(i, 99.9)};
+    if (format == TIMER_REPORT_JSONL) {
+      p = timer_fmt_str(p, "{\"timer\":\"");
+      p = timer_fmt_str(p, timer_name(i));
+      *p++ = '"';
+      for (int c = 0; c < 9; c++) {
+        *p++ = ',';
+        *p++ = '"';
+        p = timer_fmt_str(p, keys[c]);
+        p = timer_fmt_str(p, "\":");
+        p = timer_fmt_e2(p, vals[c]);
+      }
+      *p++ = '}';
+    } else {
+      p = timer_fmt_str(p, timer_name(i));
+      for (int c = 0; c < 9; c++) {
+        *p++ = sep;
+        p = timer_fmt_e2(p, vals[c]);
+      }
+    }
+    *p++ = '\n';
+  }
+
+  int fd = (strcmp(path, "-") == 0
+                ? STDOUT_FILENO
+                : open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644));
+  if (fd < 0) {
+    free(buf);
+    return -1;
+  }
+  ssize_t left = p - buf;
+  char* out = buf;
+  while (left > 0) {
+    ssize_t w = write(fd, out, (size_t)left);
+    if (w < 0)
+      break;
+    out += w;
+    left -= w;
+  }
+  if (fd != STDOUT_FILENO)
+    close(fd);
+  free(buf);
+  return (left == 0 ? 0 : -1);
+}
+
+int timer_write_trace(const char* path)
+{
+  int ntimers = timer_high_slot();
+
+  // Size the file: header plus a [name, count, deltas] section per timer
+  size_t size = sizeof(timer_trace_header);
+  for (int i = 0; i < ntimers; i++) {
+    size += MAX_NAME_SIZE + sizeof(uint64_t);
+    for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx;
+         ctx = ctx->next) {
+      if (i < ctx->nslots)
+        size += timer_slot_retained(&ctx->slots[i]) * sizeof(uint64_t);
+    }
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return -1;
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return -1;
+  }
+  char* map = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  timer_trace_header* hdr = (timer_trace_header*)map;
+  hdr->magic = TIMER_TRACE_MAGIC;
+  hdr->version = TIMER_TRACE_VERSION;
+  hdr->ntimers = ntimers;
+  hdr->name_size = MAX_NAME_SIZE;
+  hdr->sec_per_tick = timer_sec_per_tick;
+
+  // Compute each delta straight into the mapping
+  char* cur = map + sizeof(timer_trace_header);
+  for (int i = 0; i < ntimers; i++) {
+    strncpy(cur, timer_name(i), MAX_NAME_SIZE - 1);
+    cur[MAX_NAME_SIZE - 1] = '\0';
+    cur += MAX_NAME_SIZE;
+    uint64_t* count = (uint64_t*)cur;
+    cur += sizeof(uint64_t);
+    *count = 0;
+    uint64_t* out = (uint64_t*)cur;
+    for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx;
+         ctx = ctx->next) {
+      if (i >= ctx->nslots)
+        continue;
+      timer_slot* slot = &ctx->slots[i];
+      uint64_t retained = timer_slot_retained(slot);
+      // In ring mode start at the oldest retained sample
+      uint64_t first = slot->current - retained;
+      for (uint64_t j = 0; j < retained; j++) {
+        uint64_t idx = (timer_mode == TIMER_MODE_RING
+                            ? (first + j) & timer_ring_mask
+                            : first + j);
+        out[(*count)++] = slot->ends[idx] - slot->begins[idx];
+      }
+    }
+    cur += *count * sizeof(uint64_t);
+  }
+
+  munmap(map, size);
+  return 0;
+}
+
+int timer_trace_open(const char* path, timer_trace* trace)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(timer_trace_header)) {
+    close(fd);
+    return -1;
+  }
+  trace->size = st.st_size;
+  trace->map = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (trace->map == MAP_FAILED)
+    return -1;
+  trace->hdr = (timer_trace_header*)trace->map;
+  if (trace->hdr->magic != TIMER_TRACE_MAGIC ||
+      trace->hdr->version != TIMER_TRACE_VERSION) {
+    munmap(trace->map, trace->size);
+    return -1;
+  }
+  return 0;
+}
+
+/* Walk to the start of timer tidx's section in an open trace */
+static const char* timer_trace_section(const timer_trace* trace, int tidx)
+{
+  const char* cur = (const char*)trace->map + sizeof(timer_trace_header);
+  for (int i = 0; i < tidx; i++) {
+    uint64_t count;
+    memcpy(&count, cur + trace->hdr->name_size, sizeof(count));
+    cur += trace->hdr->name_size + sizeof(uint64_t) +
+           count * sizeof(uint64_t);
+  }
+  return cur;
+}
+
+int timer_trace_timers(const timer_trace* trace)
+{
+  return trace->hdr->ntimers;
+}
+
+const char* timer_trace_name(const timer_trace* trace, int tidx)
+{
+  return timer_trace_section(trace, tidx);
+}
+
+const uint64_t* timer_trace_samples(const timer_trace* trace, int tidx,
+                                    uint64_t* count)
+{
+  const char* cur = timer_trace_section(trace, tidx);
+  memcpy(count, cur + trace->hdr->name_size, sizeof(*count));
+  return (const uint64_t*)(cur + trace->hdr->name_size + sizeof(uint64_t));
+}
+
+int timer_trace_close(timer_trace* trace)
+{
+  munmap(trace->map, trace->size);
+  trace->map = NULL;
+  trace->hdr = NULL;
+  trace->size = 0;
+  return 0;
+}
+
+/* LEB128 varint append; returns bytes written */
+static size_t timer_varint_put(uint8_t* buf, uint64_t v)
+{
+  size_t n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (uint8_t)v;
+  return n;
+}
+
+/* Frame encoder state for timer_write_pack */
+typedef struct timer_pack_enc {
+  FILE* f;
+  uint8_t* buf;
+  uint32_t count;
+  size_t nbytes;
+  uint64_t prev;
+} timer_pack_enc;
+
+static void timer_pack_enc_flush(timer_pack_enc* e)
+{
+  if (e->count == 0)
+    return;
+  uint32_t fhdr[2] = {e->count, (uint32_t)e->nbytes};
+  fwrite(fhdr, sizeof(uint32_t), 2, e->f);
+  fwrite(e->buf, 1, e->nbytes, e->f);
+  e->count = 0;
+  e->nbytes = 0;
+  e->prev = 0;
+}
+
+static void timer_pack_enc_put(timer_pack_enc* e, uint64_t d)
+{
+  int64_t delta = (int64_t)(d - e->prev);
+  uint64_t z = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  e->nbytes += timer_varint_put(e->buf + e->nbytes, z);
+  e->prev = d;
+  if (++e->count == TIMER_PACK_FRAME)
+    timer_pack_enc_flush(e);
+}
+
+int timer_write_pack(const char* path)
+{
+  FILE* f = fopen(path, "wb");
+  if (f == NULL)
+    return -1;
+  int ntimers = timer_high_slot();
+  timer_pack_header hdr = {TIMER_PACK_MAGIC, TIMER_PACK_VERSION,
+                           (uint32_t)ntimers, MAX_NAME_SIZE,
+                           timer_sec_per_tick};
+  fwrite(&hdr, sizeof(hdr), 1, f);
+
+  /* Worst case a varint costs 10 bytes per sample */
+  timer_pack_enc enc = {f, (uint8_t*)malloc(TIMER_PACK_FRAME * 10), 0, 0, 0};
+  for (int i = 0; i < ntimers; i++) {
+    char name[MAX_NAME_SIZE] = {'\0'};
+    strncpy(name, timer_name(i), MAX_NAME_SIZE - 1);
+    fwrite(name, 1, MAX_NAME_SIZE, f);
+
+    uint64_t total = 0;
+    for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+      if (i < ctx->nslots)
+        total += timer_slot_retained(&ctx->slots[i]);
+    }
+    uint64_t nframes = (total + TIMER_PACK_FRAME - 1) / TIMER_PACK_FRAME;
+    fwrite(&total, sizeof(uint64_t), 1, f);
+    fwrite(&nframes, sizeof(uint64_t), 1, f);
+
+    for (timer_ctx* ctx = atomic_load(&timer_ctx_list); ctx; ctx = ctx->next) {
+      if (i >= ctx->nslots)
+        continue;
+      timer_slot* slot = &ctx->slots[i];
+      uint64_t retained = timer_slot_retained(slot);
+      uint64_t first = slot->current - retained;
+      for (uint64_t j = 0; j < retained; j++) {
+        uint64_t idx = (timer_mode == TIMER_MODE_RING
+                            ? (first + j) & timer_ring_mask
+                            : first + j);
+        timer_pack_enc_put(&enc, slot->ends[idx] - slot->begins[idx]);
+      }
+    }
+    timer_pack_enc_flush(&enc);
+  }
+  free(enc.buf);
+  fclose(f);
+  return 0;
+}
+
+int timer_pack_open(const char* path, timer_pack* pack)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(timer_pack_header)) {
+    close(fd);
+    return -1;
+  }
+  pack->size = st.st_size;
+  pack->map = mmap(NULL, pack->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pack->map == MAP_FAILED)
+    return -1;
+  pack->hdr = (timer_pack_header*)pack->map;
+  if (pack->hdr->magic != TIMER_PACK_MAGIC ||
+      pack->hdr->version != TIMER_PACK_VERSION) {
+    munmap(pack->map, pack->size);
+    return -1;
+  }
+  return 0;
+}
+
+/* Walk to the start of timer tidx's section in an open archive */
+static const char* timer_pack_section(const timer_pack* pack, int tidx)
+{
+  const char* cur = (const char*)pack->map + sizeof(timer_pack_header);
+  for (int i = 0; i < tidx; i++) {
+    uint64_t nframes;
+    memcpy(&nframes, cur + pack->hdr->name_size + sizeof(uint64_t),
+           sizeof(nframes));
+    cur += pack->hdr->name_size + 2 * sizeof(uint64_t);
+    for (uint64_t fr = 0; fr < nframes; fr++) {
+      uint32_t fhdr[2];
+      memcpy(fhdr, cur, sizeof(fhdr));
+      cur += sizeof(fhdr) + fhdr[1];
+    }
+  }
+  return cur;
+}
+
+int timer_pack_timers(const timer_pack* pack)
+{
+  return pack->hdr->ntimers;
+}
+
+const char* timer_pack_name(const timer_pack* pack, int tidx)
+{
+  return timer_pack_section(pack, tidx);
+}
+
+uint64_t timer_pack_count(const timer_pack* pack, int tidx)
+{
+  uint64_t count;
+  memcpy(&count, timer_pack_section(pack, tidx) + pack->hdr->name_size,
+         sizeof(count));
+  return count;
+}
+
+int timer_pack_close(timer_pack* pack)
+{
+  munmap(pack->map, pack->size);
+  pack->map = NULL;
+  pack->hdr = NULL;
+  pack->size = 0;
+  return 0;
+}
+
+size_t timer_pack_decode(const timer_pack* pack, int tidx, uint64_t* out,
+                         size_t max)
+{
+  const char* cur = timer_pack_section(pack, tidx);
+  uint64_t nframes;
+  memcpy(&nframes, cur + pack->hdr->name_size + sizeof(uint64_t),
+         sizeof(nframes));
+  cur += pack->hdr->name_size + 2 * sizeof(uint64_t);
+
+  size_t decoded = 0;
+  for (uint64_t fr = 0; fr < nframes && decoded < max; fr++) {
+    uint32_t fhdr[2];
+    memcpy(fhdr, cur, sizeof(fhdr));
+    const uint8_t* p = (const uint8_t*)(cur + sizeof(fhdr));
+    cur += sizeof(fhdr) + fhdr[1];
+
+    uint64_t prev = 0;
+    for (uint32_t i = 0; i < fhdr[0] && decoded < max; i++) {
+      uint64_t z = 0;
+      int shift = 0;
+      while (*p & 0x80) {
+        z |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+      }
+      z |= (uint64_t)(*p++) << shift;
+      int64_t delta = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+      prev = (uint64_t)((int64_t)prev + delta);
+      out[decoded++] = prev;
+    }
+  }
+  return decoded;
 }
 #endif
@@ -0,0 +1,51 @@
+#ifndef TIMER_SCOPE_HPP
+#define TIMER_SCOPE_HPP
+/**
+ * RAII layer over timer.h for C++ callers.
+ *
+ * ScopedTimer<ID> calls timer_begin(ID) on construction and
+ * timer_end(ID) on destruction, so a probe cannot be left unpaired
+ * across early returns or exceptions. The timer ID is a template
+ * parameter, so the index is a compile-time constant and the guard
+ * inlines down to the two clock reads. A guard whose ID is DISABLED,
+ * or whose tier is above TIMER_COMPILED_LEVEL, selects the empty
+ * specialization and is removed entirely.
+ *
+ * Usage example:
+ *
+ * constexpr int PARSE_TIMER = 1;
+ * {
+ *   timer::ScopedTimer<PARSE_TIMER> probe;
+ *   parse();
+ * }
+ * {
+ *   timer::ScopedTimer<PARSE_TIMER, TIMER_LEVEL_DEBUG> verbose;
+ *   parse_verbose();
+ * }
+ *
+ */
+#include <timer.h>
+
+namespace timer {
+
+/* Use as the ID to compile a probe out entirely */
+constexpr int DISABLED = -1;
+
+template <int ID, int LEVEL = TIMER_LEVEL_CRITICAL,
+          bool ENABLED = (ID != DISABLED && LEVEL <= TIMER_COMPILED_LEVEL)>
+class ScopedTimer {
+ public:
+  ScopedTimer() { timer_begin(ID); }
+  ~ScopedTimer() { timer_end(ID); }
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+template <int ID, int LEVEL>
+class ScopedTimer<ID, LEVEL, false> {
+ public:
+  ScopedTimer() = default;
+};
+
+} // namespace timer
+#endif
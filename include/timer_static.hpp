@@ -0,0 +1,154 @@
+#ifndef TIMER_STATIC_HPP
+#define TIMER_STATIC_HPP
+/**
+ * Compile-time-sized timer for fixed deployments.
+ *
+ * StaticTimer<NTIMERS, CAPACITY> holds its sample arrays inline with
+ * constexpr dimensions, so an instance placed in static storage (or
+ * on the stack) performs no allocation at all — no timer_init, no
+ * arena, no registry. Because the strides are compile-time constants
+ * the probe address arithmetic constant-folds, and the stats reduce
+ * over a small fixed CAPACITY is a candidate for full unrolling.
+ * Timer indices are template parameters checked with static_assert,
+ * so an out-of-range probe is a compile error rather than a runtime
+ * bounds test.
+ *
+ * Stamps come from the same clock path as timer.h (timer_raw_now),
+ * so results are comparable with the dynamic timers; the TSC backend
+ * additionally needs a timer_init() somewhere to calibrate the tick.
+ *
+ * Usage example:
+ *
+ * static timer::StaticTimer<4, 1024> timers;
+ * timers.begin<0>();
+ * work();
+ * timers.end<0>();
+ * timers.print_tsv();
+ *
+ */
+#include <timer.h>
+
+namespace timer {
+
+template <int NTIMERS, int CAPACITY>
+class StaticTimer {
+  static_assert(NTIMERS > 0, "need at least one timer");
+  static_assert(CAPACITY > 0, "need room for at least one sample");
+
+ public:
+  StaticTimer() : count_{}, names_{}, begins_{}, ends_{} {}
+
+  /* Record the start of an interval; samples past CAPACITY are
+     dropped rather than grown — sizing is the caller's contract */
+  template <int ID>
+  void begin()
+  {
+    static_assert(0 <= ID && ID < NTIMERS, "timer index out of range");
+    if (count_[ID] < CAPACITY)
+      begins_[ID][count_[ID]] = timer_raw_now();
+  }
+
+  template <int ID>
+  void end()
+  {
+    static_assert(0 <= ID && ID < NTIMERS, "timer index out of range");
+    uint64_t n = count_[ID];
+    if (n < CAPACITY) {
+      ends_[ID][n] = timer_raw_now();
+      count_[ID] = n + 1;
+    }
+  }
+
+  void set_name(int id, const char* name)
+  {
+    strncpy(names_[id], name, MAX_NAME_SIZE - 1);
+    names_[id][MAX_NAME_SIZE - 1] = '\0';
+  }
+
+  template <int ID>
+  uint64_t count() const
+  {
+    static_assert(0 <= ID && ID < NTIMERS, "timer index out of range");
+    return count_[ID];
+  }
+
+  template <int ID>
+  double min() const
+  {
+    timer_stream s = fold(ID);
+    return (s.min == UINT64_MAX ? 0.0 : (double)s.min * timer_sec_per_tick);
+  }
+
+  template <int ID>
+  double max() const
+  {
+    return (double)fold(ID).max * timer_sec_per_tick;
+  }
+
+  template <int ID>
+  double avg() const
+  {
+    timer_stream s = fold(ID);
+    return (s.count == 0 ? 0.0
+                         : (double)s.sum / (double)s.count
+                               * timer_sec_per_tick);
+  }
+
+  template <int ID>
+  double total() const
+  {
+    return (double)fold(ID).sum * timer_sec_per_tick;
+  }
+
+  template <int ID>
+  double stddev() const
+  {
+    timer_stream s = fold(ID);
+    if (s.count == 0)
+      return 0.0;
+    double mean = (double)s.sum / (double)s.count;
+    double var = ((double)s.sumsq / (double)s.count) - (mean * mean);
+    return (var < 0.0 ? 0.0 : sqrt(var)) * timer_sec_per_tick;
+  }
+
+  /* One summary row per timer with samples, in the repo's TSV shape */
+  void print_tsv(FILE* f = stdout) const
+  {
+    fprintf(f, "Timer \tCount \tMin \tMax \tAvg \tTtl \n");
+    for (int id = 0; id < NTIMERS; id++) {
+      timer_stream s = fold(id);
+      if (s.count == 0)
+        continue;
+      char num[16];
+      const char* name = names_[id];
+      if (name[0] == '\0') {
+        snprintf(num, sizeof(num), "%d", id);
+        name = num;
+      }
+      double sec = timer_sec_per_tick;
+      fprintf(f, "%s \t%llu \t%.2e \t%.2e \t%.2e \t%.2e \n", name,
+              (unsigned long long)s.count, (double)s.min * sec,
+              (double)s.max * sec,
+              (double)s.sum * sec / (double)s.count, (double)s.sum * sec);
+    }
+  }
+
+ private:
+  /* The loop bound is runtime but the strides are constexpr, so the
+     compiler sees plain contiguous arrays it can vectorize */
+  timer_stream fold(int id) const
+  {
+    timer_stream s = {0, 0, UINT64_MAX, 0, 0};
+    for (uint64_t i = 0; i < count_[id]; i++)
+      timer_stream_fold(&s, ends_[id][i] - begins_[id][i]);
+    return s;
+  }
+
+  uint64_t count_[NTIMERS];
+  char names_[NTIMERS][MAX_NAME_SIZE];
+  uint64_t begins_[NTIMERS][CAPACITY];
+  uint64_t ends_[NTIMERS][CAPACITY];
+};
+
+} // namespace timer
+#endif
@@ -0,0 +1,20 @@
+#include <timer_scope.hpp>
+
+/* A simple scoped timer example */
+int main(int argc, char** argv)
+{
+  constexpr int PRINTF_TIMER = 1;
+  timer_init(10000);
+  {
+    timer::ScopedTimer<PRINTF_TIMER> probe;
+    printf("Hello World\n");
+  }
+  {
+    /* Compiles to nothing */
+    timer::ScopedTimer<timer::DISABLED> off;
+    (void)off;
+    printf("Hello Again\n");
+  }
+  timer_destroy();
+  return 0;
+}